@@ -0,0 +1,19 @@
+# Run with cmake -P: writes OUTPUT, a header defining SOURCE_STAMP as the
+# SHA-256 of the files of SOURCES, a comma-separated list, read in order.
+string(REPLACE "," ";" SOURCE_LIST "${SOURCES}")
+set(SOURCE_HASHES "")
+foreach (SOURCE ${SOURCE_LIST})
+    if (EXISTS ${SOURCE})
+        file(SHA256 ${SOURCE} SOURCE_HASH)
+        string(APPEND SOURCE_HASHES "${SOURCE_HASH}")
+    endif ()
+endforeach ()
+string(SHA256 SOURCE_STAMP "${SOURCE_HASHES}")
+set(STAMP_HEADER "#define SOURCE_STAMP \"${SOURCE_STAMP}\"\n")
+# Left untouched when unchanged, so bvh_cache.cpp is not rebuilt
+if (EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} OLD_STAMP_HEADER)
+endif ()
+if (NOT STAMP_HEADER STREQUAL OLD_STAMP_HEADER)
+    file(WRITE ${OUTPUT} "${STAMP_HEADER}")
+endif ()
@@ -1,5 +1,10 @@
+#ifndef INCLUDE_AABB_HPP_
+#define INCLUDE_AABB_HPP_
 #include "./load_model.hpp"
+#include "./thread_pool.hpp"
 #include <algorithm>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 struct Box {
@@ -19,19 +24,106 @@ struct AABB {
     int root_id;
 };
 
+struct Bounds {
+    PaddedVec3ForGLSL min;
+    PaddedVec3ForGLSL max;
+};
+
+// Knobs shared by the builders. Costs are the SAH constants of one node
+// traversal step and one ray-triangle test.
+struct BuildParams {
+    int leaf_size = 8;
+    float traversal_cost = 1.0f;
+    float intersection_cost = 1.0f;
+    int bin_count = 16;
+    // SBVH: spatial splits are tried when the children of the best object
+    // split overlap by more than this fraction of the root area
+    float split_alpha = 1e-5f;
+    // SBVH: extra triangle references allowed, as a fraction of the input
+    float duplication_budget = 0.3f;
+    // LBVH: Morton code length, 30 (10 bits per axis) or 63 (21 bits)
+    int morton_bits = 30;
+    // PLOC: how many clusters on each side are searched for a neighbour
+    int ploc_radius = 16;
+    // Early split clipping before any builder: triangles whose box area is
+    // over `clip_ratio` times the median are cut into tighter references,
+    // at most `clip_budget` extra per input triangle. 0 turns it off.
+    float clip_budget = 0.0f;
+    float clip_ratio = 16.0f;
+};
+
+enum {
+    BUILDER_MEDIAN = 0,
+    BUILDER_SAH = 1,
+    BUILDER_SBVH = 2,
+    BUILDER_LBVH = 3,
+    BUILDER_PLOC = 4,
+    BUILDER_COUNT,
+};
+
 void print_triangle(const Triangle &t);
 
 int get_next_coord(int coord);
 
 float get_coord(int coord, const PaddedVec3ForGLSL &v);
 
+void set_coord(int coord, PaddedVec3ForGLSL &v, float value);
+
+Bounds empty_bounds();
+
+Bounds merge_bounds(const Bounds &a, const Bounds &b);
+
+Bounds merge_bounds(const Bounds &a, const PaddedVec3ForGLSL &point);
+
+// Empty (min above max) when the bounds are disjoint
+Bounds intersect_bounds(const Bounds &a, const Bounds &b);
+
+Bounds box_bounds(const Box &box);
+
+Bounds triangle_bounds(const TriangleForGLSL &triangle);
+
+PaddedVec3ForGLSL bounds_center(const Bounds &bounds);
+
+float surface_area(const Bounds &bounds);
+
+// Median builder: ranges of at most `leaf_size` triangles become leaves
 Box triangles_to_box(std::vector<Box> &boxes,
                      std::vector<TriangleForGLSL *> &triangles, int start,
-                     int end, int coord);
+                     int end, int coord, int leaf_size = 8);
 
 AABB *triangles_to_aabb(std::vector<Box> &boxes,
                         std::vector<TriangleForGLSL *> &triangles, int start,
-                        int end, int coord);
+                        int end, int coord, int leaf_size = 8);
+
+// Number of boxes the median builder emits for `span` triangles
+int count_boxes(int span, int leaf_size);
+
+// Same, remembering the count of every span in `counts` across calls
+int count_boxes(int span, int leaf_size, std::unordered_map<int, int> &counts);
+
+// Appends the binary tree rooted at `root_id` of `nodes`, stored in any
+// order, to `boxes` in the post-order the builders emit. Leaves of `nodes`
+// index `triangles`, which is reordered so every subtree covers a
+// contiguous range. Subtrees of at most `params.leaf_size` triangles become
+// a single leaf where the SAH says that is cheaper.
+AABB *linearize_tree(std::vector<Box> &boxes,
+                     std::vector<TriangleForGLSL *> &triangles,
+                     const std::vector<Box> &nodes, int root_id,
+                     const BuildParams &params);
+
+AABB *build_aabb(std::vector<Box> &boxes,
+                 std::vector<TriangleForGLSL *> &triangles, int builder,
+                 const BuildParams &params, ThreadPool &pool);
+
+const char *builder_name(int builder);
+
+// Returns -1 for an unknown name.
+int find_builder(const std::string &name);
+
+float sah_cost(const std::vector<Box> &boxes, int root_id,
+               const BuildParams &params);
 
 void print_box(std::vector<Box> boxes, int box_id, size_t depth,
                std::vector<TriangleForGLSL *> &triangles);
+
+#endif // INCLUDE_AABB_HPP_
@@ -0,0 +1,21 @@
+#ifndef INCLUDE_ARENA_BUILD_HPP_
+#define INCLUDE_ARENA_BUILD_HPP_
+#include "./aabb.hpp"
+#include <vector>
+
+// Median subtree over [start, end) written into the `count_boxes` slots of
+// `boxes` from `first_slot` on, in the post-order `triangles_to_box` emits.
+// Ranges wait on an explicit stack, at most one per level of the tree, and
+// inner bounds are merged in one sweep over the slots afterwards.
+void fill_median_slots(std::vector<Box> &boxes,
+                       std::vector<TriangleForGLSL *> &triangles, int start,
+                       int end, int coord, int first_slot, int leaf_size);
+
+// Non-recursive `triangles_to_aabb`: `boxes` grows once by the exact node
+// count, the array and the triangle order are identical. Only the median
+// builder has this form; sah, sbvh, lbvh and ploc still recurse per level.
+AABB *triangles_to_aabb_arena(std::vector<Box> &boxes,
+                              std::vector<TriangleForGLSL *> &triangles,
+                              const BuildParams &params);
+
+#endif // INCLUDE_ARENA_BUILD_HPP_
@@ -0,0 +1,43 @@
+#ifndef INCLUDE_AUTOTUNE_HPP_
+#define INCLUDE_AUTOTUNE_HPP_
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include "./ray.hpp"
+#include "./thread_pool.hpp"
+#include <string>
+#include <vector>
+
+// One configuration tried by the autotuner, with what it measured
+struct TuneCandidate {
+    BuildParams params;
+    int bvh_width;
+    double build_ms;
+    // Fastest of the timed passes over the view rays
+    double trace_ms;
+    float sah_cost;
+};
+
+// Primary rays of a fixed set of pinhole cameras placed around the centre
+// of the scene, half of them inside its bounds and half outside
+std::vector<Ray>
+autotune_rays(const std::vector<TriangleForGLSL *> &triangles);
+
+// Builds a tree with `builder` for every combination of leaf size and
+// traversal to intersection cost ratio, times it at every BVH width over
+// `rays` on the CPU and returns all candidates, fastest first. The ratio is
+// only varied for builders that use it. Other fields of `params` are kept.
+std::vector<TuneCandidate>
+autotune(const std::vector<TriangleForGLSL *> &triangles, int builder,
+         const BuildParams &params, const std::vector<Ray> &rays,
+         ThreadPool &pool);
+
+// $XDG_CONFIG_HOME/myownraytracer/profile, falling back to ~/.config, or
+// empty when neither is set
+std::string default_profile_path();
+
+// Writes the tuned options as `key=value` lines, creating the directory.
+// Returns false when the file cannot be written.
+bool save_profile(const std::string &path, const TuneCandidate &best,
+                  int builder);
+
+#endif // INCLUDE_AUTOTUNE_HPP_
@@ -0,0 +1,18 @@
+#ifndef INCLUDE_BENCHMARK_HPP_
+#define INCLUDE_BENCHMARK_HPP_
+#include "./load_model.hpp"
+#include "./material_table.hpp"
+#include "./options.hpp"
+#include <string>
+#include <vector>
+
+// Runs the benchmark named by `options.bench` over the loaded triangles and
+// prints the results. `vertex_ids[i]` are the glTF vertices of
+// `*triangles[i]`, `materials` the table their material_id index. Returns
+// false for an unknown benchmark.
+bool run_benchmark(const std::vector<TriangleForGLSL *> &triangles,
+                   const std::vector<TriangleVertexIds> &vertex_ids,
+                   const std::vector<MaterialForGLSL> &materials,
+                   const Options &options);
+
+#endif // INCLUDE_BENCHMARK_HPP_
@@ -0,0 +1,43 @@
+#ifndef INCLUDE_BVH_CACHE_HPP_
+#define INCLUDE_BVH_CACHE_HPP_
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include "./thread_pool.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bump whenever the file layout changes. Trees from other sources are told
+// apart by the source stamp in the key.
+const uint32_t BVH_CACHE_VERSION = 1;
+
+// FNV-1a over the vertices of `triangles` in load order, the builder, every
+// build parameter, the treelet passes, BVH_CACHE_VERSION, the source stamp
+// and the size of a Box. Chunks of triangles are hashed in parallel.
+uint64_t bvh_cache_key(const std::vector<TriangleForGLSL *> &triangles,
+                       int builder, const BuildParams &params,
+                       int treelet_passes, ThreadPool &pool);
+
+// $XDG_CACHE_HOME/myownraytracer, falling back to ~/.cache, or empty when
+// neither is set
+std::string default_cache_dir();
+
+std::string bvh_cache_path(const std::string &dir, uint64_t key);
+
+// Reads the boxes and the triangle order stored for `key`. `triangles` is
+// filled from `loaded`, the triangles in load order. Returns false on a
+// miss or a file that does not match.
+bool load_cached_bvh(const std::string &dir, uint64_t key,
+                     const std::vector<TriangleForGLSL *> &loaded,
+                     std::vector<Box> &boxes,
+                     std::vector<TriangleForGLSL *> &triangles, int &root_id);
+
+// Stores the built tree and the order of `triangles` as indices into
+// `loaded`. Returns false when the file cannot be written.
+bool save_cached_bvh(const std::string &dir, uint64_t key,
+                     const std::vector<TriangleForGLSL *> &loaded,
+                     const std::vector<Box> &boxes,
+                     const std::vector<TriangleForGLSL *> &triangles,
+                     int root_id);
+
+#endif // INCLUDE_BVH_CACHE_HPP_
@@ -0,0 +1,47 @@
+#ifndef INCLUDE_DYNAMIC_BVH_HPP_
+#define INCLUDE_DYNAMIC_BVH_HPP_
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include "./refit.hpp"
+#include "./thread_pool.hpp"
+#include <vector>
+
+// Triangles added together, usually one model file
+struct DynamicBatch {
+    std::vector<int> leaves;
+    int triangle_start;
+    int triangle_count;
+};
+
+// BVH that takes and drops batches of triangles at runtime. Boxes and
+// triangles never move: removed ones leave holes that later batches reuse,
+// new ones go at the end, so the uploaded buffers only grow and ranges
+// already on the GPU stay valid. Inner boxes have start and end 0.
+struct DynamicBVH {
+    std::vector<Box> boxes;
+    std::vector<int> parents;
+    std::vector<TriangleForGLSL> triangles;
+    std::vector<int> free_boxes;
+    // Holes left by removed batches
+    std::vector<DirtyRange> free_triangles;
+    // A removed batch keeps its id with no leaves
+    std::vector<DynamicBatch> batches;
+    // -1 while the tree is empty
+    int root_id = -1;
+    // Written since the last upload, boxes may repeat
+    std::vector<int> dirty_boxes;
+    std::vector<DirtyRange> dirty_triangles;
+};
+
+// Builds a tree over `triangles` with `builder` and inserts its leaves one
+// by one where they grow the SAH cost least, rotating the boxes on the way
+// back to the root. The first batch becomes the tree as built. Copies the
+// triangles, `triangles` stays owned by the caller. Returns the batch id.
+int insert_batch(DynamicBVH &bvh, std::vector<TriangleForGLSL *> triangles,
+                 int builder, const BuildParams &params, ThreadPool &pool);
+
+// Removes every leaf of the batch. Returns false for an unknown or already
+// removed batch.
+bool remove_batch(DynamicBVH &bvh, int batch_id);
+
+#endif // INCLUDE_DYNAMIC_BVH_HPP_
@@ -0,0 +1,50 @@
+#ifndef INCLUDE_EARLY_SPLIT_HPP_
+#define INCLUDE_EARLY_SPLIT_HPP_
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include <vector>
+
+// Triangle references after early split clipping (Ernst and Greiner, "Early
+// Split Clipping for Bounding Volume Hierarchies")
+struct ClippedReferences {
+    // Copies of the split triangles, `min` and `max` narrowed to one piece
+    std::vector<TriangleForGLSL> proxies;
+    // Index into the input triangles of every proxy
+    std::vector<int> proxy_triangles;
+    // What the builder runs over: the triangles that were not split, then
+    // the proxies
+    std::vector<TriangleForGLSL *> references;
+};
+
+// Cuts the boxes of triangles whose box area is over `params.clip_ratio`
+// times the median into tighter pieces, largest piece first, each cut at
+// the middle of its longest axis. Stops after `params.clip_budget *
+// triangles.size()` extra references.
+ClippedReferences clip_large_triangles(
+    const std::vector<TriangleForGLSL *> &triangles,
+    const BuildParams &params);
+
+// Points every proxy in `references` back at its triangle in `triangles`.
+// The upload keeps one copy of each: order_triangles maps the references
+// to it.
+void resolve_clipped_references(
+    std::vector<TriangleForGLSL *> &references,
+    const ClippedReferences &clipped,
+    const std::vector<TriangleForGLSL *> &triangles);
+
+// Clips `triangles`, runs `build(references, params)` over the references
+// with clipping turned off, and leaves in `triangles` the references of the
+// built tree, every proxy pointing back at its triangle
+template <typename Build>
+AABB *build_clipped(std::vector<TriangleForGLSL *> &triangles,
+                    const BuildParams &params, const Build &build) {
+    ClippedReferences clipped = clip_large_triangles(triangles, params);
+    BuildParams unclipped = params;
+    unclipped.clip_budget = 0;
+    AABB *aabb = build(clipped.references, unclipped);
+    resolve_clipped_references(clipped.references, clipped, triangles);
+    triangles.swap(clipped.references);
+    return aabb;
+}
+
+#endif // INCLUDE_EARLY_SPLIT_HPP_
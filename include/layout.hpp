@@ -0,0 +1,29 @@
+#ifndef INCLUDE_LAYOUT_HPP_
+#define INCLUDE_LAYOUT_HPP_
+#include "./aabb.hpp"
+#include <string>
+#include <vector>
+
+// Order of the boxes in memory. The builders emit post-order: children
+// before parents, the root last.
+enum {
+    LAYOUT_POST_ORDER = 0,
+    // Pre-order, the left child right after its parent
+    LAYOUT_DFS = 1,
+    // Cache-oblivious van Emde Boas order: the top half of the levels first,
+    // then every subtree below it, each laid out the same way
+    LAYOUT_VEB = 2,
+    LAYOUT_COUNT,
+};
+
+const char *layout_name(int layout);
+
+// Returns -1 for an unknown name.
+int find_layout(const std::string &name);
+
+// Reorders the tree rooted at `root_id` into `layout`, remapping the child
+// ids, and returns the new root id. Boxes not reachable from the root are
+// dropped. Triangle ranges are unchanged.
+int relayout_bvh(std::vector<Box> &boxes, int root_id, int layout);
+
+#endif // INCLUDE_LAYOUT_HPP_
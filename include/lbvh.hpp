@@ -0,0 +1,33 @@
+#ifndef INCLUDE_LBVH_HPP_
+#define INCLUDE_LBVH_HPP_
+#include "./aabb.hpp"
+#include "./thread_pool.hpp"
+#include <cstdint>
+#include <vector>
+
+struct MortonPrimitive {
+    uint64_t code;
+    TriangleForGLSL *triangle;
+};
+
+// Interleaves the low 10 (30-bit code) or 21 (63-bit code) bits of x, y, z
+uint64_t morton_code(uint32_t x, uint32_t y, uint32_t z, int bits);
+
+// Least significant digit radix sort on the low `key_bits` bits of `code`.
+// Every pass builds per-chunk digit histograms and scatters in parallel.
+void radix_sort(std::vector<MortonPrimitive> &primitives, int key_bits,
+                ThreadPool &pool);
+
+// Reorders `triangles` along a Morton curve through their centroids.
+// `bits` is 30 or 63; returns the sorted codes.
+std::vector<uint64_t> sort_by_morton(std::vector<TriangleForGLSL *> &triangles,
+                                     int bits, ThreadPool &pool);
+
+// Linear BVH: sorts the triangles by Morton code and splits every node where
+// the highest differing code bit flips. Much faster than the other builders,
+// but the tree only follows the curve, not the geometry.
+AABB *triangles_to_aabb_lbvh(std::vector<Box> &boxes,
+                             std::vector<TriangleForGLSL *> &triangles,
+                             const BuildParams &params, ThreadPool &pool);
+
+#endif // INCLUDE_LBVH_HPP_
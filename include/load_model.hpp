@@ -39,6 +39,15 @@ struct Matrix4 {
     Vec4 v4;
 };
 
+// Vertices of a triangle in the glTF index buffers: into the vertices of
+// its mesh, every primitive numbered after the previous ones. Once in world
+// space, node_to_triangles numbers every mesh instance apart.
+struct TriangleVertexIds {
+    uint32_t v1;
+    uint32_t v2;
+    uint32_t v3;
+};
+
 struct Triangle {
     Vec3 v1;
     Vec3 v2;
@@ -54,6 +63,9 @@ struct Triangle {
     bool double_sided;
     Vec3 emissive_factor;
     Vec4 base_color_factor;
+    TriangleVertexIds vertex_ids;
+    // Into the material table of its file, see primitive_material_id
+    uint32_t material_id;
 };
 
 struct Vec2ForGLSL {
@@ -61,6 +73,12 @@ struct Vec2ForGLSL {
     float y;
 };
 
+struct Vec3ForGLSL {
+    float x;
+    float y;
+    float z;
+};
+
 struct PaddedVec3ForGLSL {
     float x;
     float y;
@@ -101,7 +119,11 @@ struct TriangleForGLSL {
     float alpha_cutoff;
     uint32_t double_sided;
 
-    PaddedVec3ForGLSL emissive_factor;
+    // vec3 emissive_factor and uint material_id share a vec4 in std430.
+    // The material fields above are copies of the material at material_id
+    // in the table of binding 15.
+    Vec3ForGLSL emissive_factor;
+    uint32_t material_id;
     Vec4ForGLSL base_color_factor;
 };
 
@@ -112,8 +134,16 @@ struct OurNode {
     Vec3 scale;
     Matrix4 matrix;
     std::vector<OurNode> children;
-    std::vector<Triangle> primitives;
+    // glTF mesh index into `meshes` of the root node, -1 without a mesh
+    int mesh = -1;
+    // Root node only: triangles of every glTF mesh, in its object space,
+    // shared by all the nodes that reference it
+    std::vector<std::vector<Triangle>> meshes;
+    // Root node only: number of glTF vertices of every mesh
+    std::vector<uint32_t> mesh_vertices;
     std::vector<tinygltf::Image> images;
+    // Root node only: what append_materials builds the material table from
+    std::vector<tinygltf::Material> materials;
 };
 
 Vec3 make_vec3(const std::vector<double> &vec);
@@ -126,6 +156,8 @@ Vec4 make_vec4(const Vec3 &vec, double w);
 
 Matrix4 make_matrix4(const std::vector<double> &vec);
 
+Matrix4 mul_matrixes(const Matrix4 &m1, const Matrix4 &m2);
+
 Matrix4 compose_matrix(const Vec3 &translation, const Vec4 &rotation,
                        const Vec3 &scale);
 
@@ -133,11 +165,52 @@ void print_json_node(const OurNode &node);
 
 void print_node(const OurNode &node, size_t depth = 0);
 
+// Triangles of every primitive of `mesh`, and in `vertex_count` the number
+// of vertices their ids index
+std::vector<Triangle> load_mesh(const tinygltf::Mesh &mesh,
+                                const tinygltf::Model &model,
+                                uint32_t &vertex_count);
+
 void load_node(OurNode *parent, const tinygltf::Node &node,
                const tinygltf::Model &model, float global_scale);
 
 OurNode load_model(std::string filename);
 
-std::vector<TriangleForGLSL*> node_to_triangles(const OurNode &node);
+// `primitive` with its vertices and bounds transformed by `matrix`
+TriangleForGLSL triangle_for_glsl(const Triangle &primitive,
+                                  const Matrix4 &matrix);
+
+// Number of triangles node_to_triangles appends for `node`
+size_t count_node_triangles(const OurNode &node);
+
+// Appends every triangle of the model rooted at `node` in world space to
+// `triangles`, one copy per node that references a mesh
+void node_to_triangles(const OurNode &node,
+                       std::vector<TriangleForGLSL> &triangles);
+
+// node_to_triangles that also appends the vertices of every triangle to
+// `vertex_ids`, numbered from `vertex_count` on, which counts the vertices
+// of every mesh instance. Vertices that share a position but not a UV keep
+// the ids the index buffers gave them.
+void node_to_triangles(const OurNode &node,
+                       std::vector<TriangleForGLSL> &triangles,
+                       std::vector<TriangleVertexIds> &vertex_ids,
+                       uint32_t &vertex_count);
+
+// Pointers to every triangle of `triangles`, in order: what the builders
+// reorder. They stay valid while `triangles` is not resized.
+std::vector<TriangleForGLSL *>
+triangle_pointers(std::vector<TriangleForGLSL> &triangles);
+
+// Reorders `triangles` in place into the order of `references`, pointers
+// into it, keeping every referenced triangle once, in the order of its
+// first reference, and points `references` at the reordered triangles.
+// Returns nothing when no two references share a triangle, else the index
+// of the triangle of every reference, as sbvh and clip= need.
+// `vertex_ids`, when not empty, follows the triangles.
+std::vector<uint32_t>
+order_triangles(std::vector<TriangleForGLSL> &triangles,
+                std::vector<TriangleForGLSL *> &references,
+                std::vector<TriangleVertexIds> &vertex_ids);
 
 #endif // INCLUDE_LOAD_MODEL_HPP_
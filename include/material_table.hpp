@@ -0,0 +1,47 @@
+#ifndef INCLUDE_MATERIAL_TABLE_HPP_
+#define INCLUDE_MATERIAL_TABLE_HPP_
+#include "./load_model.hpp"
+#include "./tiny_gltf.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Material fields of TriangleForGLSL, stored once per glTF material.
+// std430 layout:
+//
+//     uint texture_id, metallic_roughness_texture_id;
+//     float metallic_factor, roughness_factor, alpha_cutoff;
+//     uint double_sided;
+//     vec3 emissive_factor;
+//     vec4 base_color_factor;
+struct MaterialForGLSL {
+    uint32_t texture_id;
+    uint32_t metallic_roughness_texture_id;
+    float metallic_factor;
+    float roughness_factor;
+    float alpha_cutoff;
+    uint32_t double_sided;
+    uint32_t padding[2];
+    PaddedVec3ForGLSL emissive_factor;
+    Vec4ForGLSL base_color_factor;
+};
+
+// Index of the material of a glTF primitive into the table append_materials
+// builds for its file, which holds every material of the file, then every
+// material again without its textures and base color factor for primitives
+// without texture coordinates, then the glTF default material. `material`
+// is the index of the primitive into the `material_count` materials of the
+// file, or -1.
+uint32_t primitive_material_id(int material, bool textured,
+                               size_t material_count);
+
+// The alpha cutoff of a MASK material, 0 for OPAQUE and BLEND ones, which
+// are not alpha tested
+float material_alpha_cutoff(const tinygltf::Material &material);
+
+// Appends the table of the materials of one file to `materials`. The ids
+// of its triangles are offset by the size of `materials` before the call.
+void append_materials(const std::vector<tinygltf::Material> &gltf_materials,
+                      std::vector<MaterialForGLSL> &materials);
+
+#endif // INCLUDE_MATERIAL_TABLE_HPP_
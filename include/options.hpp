@@ -0,0 +1,71 @@
+#ifndef INCLUDE_OPTIONS_HPP_
+#define INCLUDE_OPTIONS_HPP_
+#include <string>
+#include <vector>
+
+#include "./aabb.hpp"
+#include "./autotune.hpp"
+#include "./bvh_cache.hpp"
+#include "./controls.hpp"
+#include "./layout.hpp"
+#include "./scene.hpp"
+#include "./triangle_streams.hpp"
+
+struct Options {
+    std::string shader_path;
+    std::vector<std::string> model_paths;
+    std::string sky_path;
+    int mode = MODE_MOUSE;
+    int builder = BUILDER_MEDIAN;
+    int scene = SCENE_FLAT;
+    // scene=dynamic: models inserted and removed while running
+    std::vector<std::string> stream_paths;
+    // Children per node of the tree uploaded to binding 8, 2 uploads none
+    int bvh_width = 2;
+    // Also upload the 8-bit quantized tree to binding 9
+    bool quantized = false;
+    // Also upload the parent and skip links of the boxes to binding 10
+    bool stackless = false;
+    // How the triangles of the flat scene are uploaded, TRIANGLES_FULL to
+    // binding 3 by default
+    int triangle_streams = TRIANGLES_FULL;
+    int layout = LAYOUT_POST_ORDER;
+    // Camera views the flat scene tree is built for, V appends the current
+    // one
+    std::string views_path;
+    // Treelet restructuring passes over the built tree
+    int treelet_passes = 0;
+    // Height of the wave the flat scene is animated with every frame, as a
+    // share of its width; 0 keeps it still
+    float animate = 0;
+    BuildParams build_params;
+    int threads = default_thread_count();
+    // Name of the benchmark to run instead of opening a window
+    std::string bench;
+    // File the scene statistics are written to as JSON, "-" for stdout
+    std::string stats_path;
+    // Directory of built trees of the flat scene, "none" builds every time
+    std::string cache_dir = default_cache_dir();
+    // Tuned options read before the command line, "none" reads nothing
+    std::string profile_path = default_profile_path();
+};
+
+void print_usage(const char *program);
+
+// Applies one `key=value` argument, anything else is a model path. Prints
+// the problem and returns false on an invalid value.
+bool parse_option(const std::string &arg, Options &options);
+
+// Applies the tuned options of the profile at `path`, one per line. A
+// missing file is not an error.
+bool load_profile(const std::string &path, Options &options);
+
+// Fills `options` from the profile, then from the command line, which
+// overrides it. Prints the problem and returns false on an invalid argument.
+bool parse_options(int argc, char *argv[], Options &options);
+
+// True when the last stats argument is `--stats` or `stats=-`, which print
+// the JSON to stdout. Checked before parse_options, which may already log.
+bool stats_to_stdout(int argc, char *argv[]);
+
+#endif // INCLUDE_OPTIONS_HPP_
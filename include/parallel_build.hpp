@@ -0,0 +1,15 @@
+#ifndef INCLUDE_PARALLEL_BUILD_HPP_
+#define INCLUDE_PARALLEL_BUILD_HPP_
+#include "./aabb.hpp"
+#include "./thread_pool.hpp"
+#include <vector>
+
+// Task-parallel version of `triangles_to_aabb`. The node count of every
+// median subtree is known up front, so `boxes` is sized once and each task
+// writes its subtree into its own slots. The array and the triangle order
+// are identical to the serial builder for any thread count.
+AABB *triangles_to_aabb_parallel(std::vector<Box> &boxes,
+                                 std::vector<TriangleForGLSL *> &triangles,
+                                 const BuildParams &params, ThreadPool &pool);
+
+#endif // INCLUDE_PARALLEL_BUILD_HPP_
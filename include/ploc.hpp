@@ -0,0 +1,16 @@
+#ifndef INCLUDE_PLOC_HPP_
+#define INCLUDE_PLOC_HPP_
+#include "./aabb.hpp"
+#include "./thread_pool.hpp"
+#include <vector>
+
+// Parallel Locally-Ordered Clustering. Starts with one cluster per triangle
+// in Morton order; every round each cluster finds the neighbour within
+// `params.ploc_radius` positions whose merged box has the smallest surface
+// area, and mutual nearest neighbours merge. The neighbour search runs on
+// the pool. Slower to build than lbvh, close to sah in quality.
+AABB *triangles_to_aabb_ploc(std::vector<Box> &boxes,
+                             std::vector<TriangleForGLSL *> &triangles,
+                             const BuildParams &params, ThreadPool &pool);
+
+#endif // INCLUDE_PLOC_HPP_
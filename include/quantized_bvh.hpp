@@ -0,0 +1,43 @@
+#ifndef INCLUDE_QUANTIZED_BVH_HPP_
+#define INCLUDE_QUANTIZED_BVH_HPP_
+#include "./aabb.hpp"
+#include "./ray.hpp"
+#include <cstdint>
+#include <vector>
+
+// 32-byte binary node holding the bounds of its two children as 8-bit
+// offsets from its own corner. std430 layout:
+//
+//     vec3 origin;
+//     uint exponents;   // biased exponent of x, y and z in bytes 0-2
+//     uint quantized[3];
+//     int index;
+//
+// An inner node has nonzero exponents; its children are the nodes `index`
+// and `index + 1`. Byte k of `quantized` is (quantized[k / 4] >> 8 * (k % 4))
+// & 0xff; bytes 0-2 are min x, y, z of the left child, 3-5 its max, 6-11 the
+// same for the right child. A coordinate decodes as
+//
+//     origin + float(byte) * uintBitsToFloat(exponent << 23)
+//
+// and the decoded box always contains the child. A leaf has exponents 0 and
+// holds triangles [index, index + quantized[0]). The root is node 0.
+struct QuantizedBox {
+    float origin[3];
+    uint32_t exponents;
+    uint8_t quantized[12];
+    int32_t index;
+};
+
+// Encodes the binary tree, sibling pairs stored next to each other
+std::vector<QuantizedBox> quantize_bvh(const std::vector<Box> &boxes,
+                                       int root_id);
+
+// Decoded bounds of child 0 (left) or 1 (right) of an inner node
+Bounds quantized_child_bounds(const QuantizedBox &node, int child);
+
+Hit trace_quantized_bvh(const std::vector<QuantizedBox> &nodes,
+                        const std::vector<TriangleForGLSL *> &triangles,
+                        const Ray &ray, TraversalStats &stats);
+
+#endif // INCLUDE_QUANTIZED_BVH_HPP_
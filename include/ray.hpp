@@ -0,0 +1,130 @@
+#ifndef INCLUDE_RAY_HPP_
+#define INCLUDE_RAY_HPP_
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+const int CACHE_LINE_BYTES = 64;
+
+// CPU reference of the shader traversal, used to measure node layouts
+struct Ray {
+    PaddedVec3ForGLSL origin;
+    PaddedVec3ForGLSL direction;
+    PaddedVec3ForGLSL inv_direction;
+};
+
+// `triangle` indexes the triangle list the tree was built over, -1 on a miss
+struct Hit {
+    float t;
+    int triangle;
+};
+
+// Work done by traversals, summed over rays: nodes fetched, ray-box and
+// ray-triangle tests, the distinct 64-byte lines of the node array each
+// ray touched (trace_bvh with `count_cache_lines` only) and those of the
+// triangle data (the traversals of triangle_streams.hpp only)
+struct TraversalStats {
+    long long nodes = 0;
+    long long boxes = 0;
+    long long triangles = 0;
+    long long cache_lines = 0;
+    long long triangle_lines = 0;
+};
+
+Ray make_ray(const PaddedVec3ForGLSL &origin,
+             const PaddedVec3ForGLSL &direction);
+
+Hit no_hit();
+
+// Distance at which the ray enters the box, infinity when it misses the box
+// or enters it beyond `t_max`
+float intersect_ray_box(const Ray &ray, const PaddedVec3ForGLSL &min,
+                        const PaddedVec3ForGLSL &max, float t_max);
+
+// Möller-Trumbore over the first vertex and the edges from it to the other
+// two, infinity on a miss
+float intersect_ray_edges(const Ray &ray, const PaddedVec3ForGLSL &v1,
+                          const PaddedVec3ForGLSL &e1,
+                          const PaddedVec3ForGLSL &e2);
+
+// Möller-Trumbore, infinity on a miss
+float intersect_ray_vertices(const Ray &ray, const PaddedVec3ForGLSL &v1,
+                             const PaddedVec3ForGLSL &v2,
+                             const PaddedVec3ForGLSL &v3);
+
+float intersect_ray_triangle(const Ray &ray, const TriangleForGLSL &triangle);
+
+// Closest hit in the binary tree; children are visited nearest first.
+// `test(i)` intersects triangle `i` of the leaves and returns its distance,
+// infinity on a miss, so any triangle layout can be traced.
+template <typename Test>
+Hit trace_bvh(const std::vector<Box> &boxes, int root_id, const Ray &ray,
+              TraversalStats &stats, const Test &test,
+              bool count_cache_lines = false) {
+    Hit hit = no_hit();
+    std::vector<long long> lines;
+    // Boxes are read where they are tested
+    auto touch = [&lines, count_cache_lines](int box_id) {
+        if (!count_cache_lines) {
+            return;
+        }
+        long long offset = static_cast<long long>(box_id) * sizeof(Box);
+        lines.push_back(offset / CACHE_LINE_BYTES);
+        lines.push_back((offset + sizeof(Box) - 1) / CACHE_LINE_BYTES);
+    };
+    touch(root_id);
+    stats.boxes++;
+    std::vector<std::pair<int, float>> stack = {
+        {root_id, intersect_ray_box(ray, boxes[root_id].min,
+                                    boxes[root_id].max, hit.t)}};
+    while (!stack.empty()) {
+        auto [box_id, t_entry] = stack.back();
+        stack.pop_back();
+        if (t_entry >= hit.t) {
+            continue;
+        }
+        const Box &box = boxes[box_id];
+        stats.nodes++;
+        if (box.left_id == -1) {
+            for (int i = box.start; i < box.end; i++) {
+                stats.triangles++;
+                float t = test(i);
+                if (t < hit.t) {
+                    hit = Hit{t, i};
+                }
+            }
+            continue;
+        }
+        touch(box.left_id);
+        touch(box.right_id);
+        const Box &left = boxes[box.left_id];
+        const Box &right = boxes[box.right_id];
+        float t_left = intersect_ray_box(ray, left.min, left.max, hit.t);
+        float t_right = intersect_ray_box(ray, right.min, right.max, hit.t);
+        stats.boxes += 2;
+        std::pair<int, float> near{box.left_id, t_left};
+        std::pair<int, float> far{box.right_id, t_right};
+        if (t_right < t_left) {
+            std::swap(near, far);
+        }
+        if (far.second < hit.t) {
+            stack.push_back(far);
+        }
+        if (near.second < hit.t) {
+            stack.push_back(near);
+        }
+    }
+    std::sort(lines.begin(), lines.end());
+    stats.cache_lines +=
+        std::unique(lines.begin(), lines.end()) - lines.begin();
+    return hit;
+}
+
+// trace_bvh over the triangle pointers the tree was built with
+Hit trace_bvh(const std::vector<Box> &boxes, int root_id,
+              const std::vector<TriangleForGLSL *> &triangles, const Ray &ray,
+              TraversalStats &stats, bool count_cache_lines = false);
+
+#endif // INCLUDE_RAY_HPP_
@@ -0,0 +1,53 @@
+#ifndef INCLUDE_REFIT_HPP_
+#define INCLUDE_REFIT_HPP_
+#include "./aabb.hpp"
+#include "./thread_pool.hpp"
+#include <vector>
+
+// Boxes of a tree grouped by height: leaves first, the root last. Nodes of
+// one level are independent, so every level is refit in parallel.
+struct RefitPlan {
+    std::vector<std::vector<int>> levels;
+};
+
+// Half-open index range, empty when begin >= end
+struct DirtyRange {
+    int begin;
+    int end;
+};
+
+// Changed indices in ascending runs. Runs less than REFIT_UPLOAD_GAP apart
+// are merged, so each range is one upload.
+struct RefitResult {
+    std::vector<DirtyRange> triangles;
+    std::vector<DirtyRange> boxes;
+};
+
+const int REFIT_UPLOAD_GAP = 64;
+
+// Runs of the set entries of `dirty`, merged as in RefitResult
+std::vector<DirtyRange> dirty_ranges(const std::vector<char> &dirty);
+
+// Number of indices the ranges cover
+int range_size(const std::vector<DirtyRange> &ranges);
+
+RefitPlan make_refit_plan(const std::vector<Box> &boxes, int root_id);
+
+// Moves the vertices of `triangles` to `positions` (three per triangle, in
+// the current triangle order), recomputes the `min`/`max` of every moved
+// triangle and the bounds of every box above one, and returns which
+// triangles and boxes changed. The topology is kept, so the tree degrades
+// when triangles move far; rebuild then. Trees from sbvh are not supported:
+// their leaves hold clipped parts of triangles that may repeat.
+RefitResult refit_aabb(std::vector<Box> &boxes,
+                       std::vector<TriangleForGLSL *> &triangles,
+                       const std::vector<PaddedVec3ForGLSL> &positions,
+                       const RefitPlan &plan, ThreadPool &pool);
+
+// Vertices of `triangles` waved along y, `amplitude` high at `phase`, in
+// the order refit_aabb takes them
+std::vector<PaddedVec3ForGLSL>
+wave_positions(const std::vector<TriangleForGLSL> &triangles, float amplitude,
+               float wavelength, float phase);
+
+#endif // INCLUDE_REFIT_HPP_
@@ -0,0 +1,54 @@
+#ifndef INCLUDE_SAH_HPP_
+#define INCLUDE_SAH_HPP_
+#include "./aabb.hpp"
+#include <vector>
+
+struct SAHPrimitive {
+    Bounds bounds;
+    PaddedVec3ForGLSL centroid;
+    TriangleForGLSL *triangle;
+};
+
+struct SAHBin {
+    Bounds bounds;
+    int count;
+};
+
+// Split plane between bins `bin - 1` and `bin` of `axis`, with the bounds of
+// both sides. Axis -1 means no plane separates the primitives.
+struct SAHSplit {
+    int axis;
+    int bin;
+    float cost;
+    Bounds left;
+    Bounds right;
+};
+
+int sah_bin_index(float centroid, float centroid_min, float scale,
+                  int bin_count);
+
+// Sweeps the centroid bins of every axis over primitives [start, end) and
+// returns the cheapest plane.
+SAHSplit find_sah_split(const std::vector<SAHPrimitive> &primitives, int start,
+                        int end, const Bounds &bounds, const Bounds &centroids,
+                        const BuildParams &params);
+
+// Moves the primitives left of `split` to the front of [start, end) and
+// returns the first one on the right. Falls back to the middle when the split
+// does not separate anything.
+int partition_sah_split(std::vector<SAHPrimitive> &primitives, int start,
+                        int end, const Bounds &centroids, const SAHSplit &split,
+                        const BuildParams &params);
+
+// Binned Surface Area Heuristic builder. Emits the same post-order `Box`
+// array as `triangles_to_aabb`, reordering `triangles` so that every leaf
+// covers a contiguous [start, end) range.
+Box triangles_to_box_sah(std::vector<Box> &boxes,
+                         std::vector<TriangleForGLSL *> &triangles, int start,
+                         int end, const BuildParams &params);
+
+AABB *triangles_to_aabb_sah(std::vector<Box> &boxes,
+                            std::vector<TriangleForGLSL *> &triangles,
+                            const BuildParams &params);
+
+#endif // INCLUDE_SAH_HPP_
@@ -0,0 +1,22 @@
+#ifndef INCLUDE_SBVH_HPP_
+#define INCLUDE_SBVH_HPP_
+#include "./aabb.hpp"
+#include <vector>
+
+// Bounds of the part of the triangle between `low` and `high` along `axis`,
+// empty if there is none
+Bounds clip_triangle(const TriangleForGLSL &triangle, int axis, float low,
+                     float high);
+
+// Spatial split BVH. Besides SAH object splits, a node may be cut by a plane
+// that clips the triangles crossing it, so a triangle can be referenced by
+// several leaves, each with a tighter box. At most
+// `params.duplication_budget * triangles.size()` extra references are made.
+//
+// On return `triangles` is the reference list the leaf [start, end) ranges
+// point into; a duplicated triangle appears once per leaf it overlaps.
+AABB *triangles_to_aabb_sbvh(std::vector<Box> &boxes,
+                             std::vector<TriangleForGLSL *> &triangles,
+                             const BuildParams &params);
+
+#endif // INCLUDE_SBVH_HPP_
@@ -0,0 +1,88 @@
+#ifndef INCLUDE_SCENE_HPP_
+#define INCLUDE_SCENE_HPP_
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include "./thread_pool.hpp"
+#include <vector>
+
+enum {
+    SCENE_FLAT = 0,
+    SCENE_INSTANCED = 1,
+    // One DynamicBVH batch per model, more are streamed in at runtime
+    SCENE_DYNAMIC = 2,
+};
+
+// World from object transform: rows of the upper 3x4 part of a Matrix4,
+// translation in `w`
+struct Transform {
+    Vec4ForGLSL rows[3];
+};
+
+// Triangles of one mesh in object space and their bottom-level BVH
+struct Mesh {
+    std::vector<TriangleForGLSL> triangles;
+    std::vector<Box> boxes;
+    int root_id = -1;
+    // Where the mesh starts in the uploaded triangle and box buffers
+    int triangle_offset = 0;
+    int box_offset = 0;
+};
+
+struct Instance {
+    int mesh_id;
+    Transform transform;
+};
+
+// std430 layout of the instance buffer, 112 bytes:
+//
+//     struct Instance {
+//         vec4 world_from_object[3];
+//         vec4 object_from_world[3];
+//         int root_id;    // root of the mesh BVH in the boxes buffer
+//         int mesh_id;
+//         int padding[2];
+//     };
+struct InstanceForGLSL {
+    Transform world_from_object;
+    Transform object_from_world;
+    int root_id;
+    int mesh_id;
+    int padding[2];
+};
+
+// Two-level scene: a BVH per mesh (BLAS) built once in object space, and a
+// top-level BVH (TLAS) over the world bounds of the instances. TLAS boxes
+// use the Box layout; a leaf holds the single instance `start`.
+struct Scene {
+    std::vector<Mesh> meshes;
+    std::vector<Instance> instances;
+    std::vector<Box> tlas;
+    int tlas_root_id = -1;
+};
+
+Transform make_transform(const Matrix4 &matrix);
+
+Transform inverse_transform(const Transform &transform);
+
+PaddedVec3ForGLSL transform_point(const Transform &transform,
+                                  const PaddedVec3ForGLSL &point);
+
+// Adds every mesh the model rooted at `node` references once, and an
+// instance per referencing node placing it with the accumulated matrices
+void add_node_to_scene(Scene &scene, const OurNode &node);
+
+// Builds the BVH of every mesh with `builder`. Call build_tlas afterwards.
+void build_blas(Scene &scene, int builder, const BuildParams &params,
+                 ThreadPool &pool);
+
+// Rebuilds only the TLAS, after instances were moved, added or removed
+void build_tlas(Scene &scene);
+
+// Triangles and boxes of every mesh, concatenated with the offsets applied
+std::vector<TriangleForGLSL> scene_triangles(const Scene &scene);
+
+std::vector<Box> scene_blas_boxes(const Scene &scene);
+
+std::vector<InstanceForGLSL> scene_instances(const Scene &scene);
+
+#endif // INCLUDE_SCENE_HPP_
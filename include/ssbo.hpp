@@ -0,0 +1,104 @@
+#ifndef INCLUDE_SSBO_HPP_
+#define INCLUDE_SSBO_HPP_
+#include "./aabb.hpp"
+#include "./dynamic_bvh.hpp"
+#include "./refit.hpp"
+#include "./scene.hpp"
+#include "./triangle_streams.hpp"
+#include "./use_opengl.h"
+#include <cstddef>
+#include <vector>
+
+// Shader storage buffer bindings the shaders read
+enum {
+    SSBO_TRIANGLES = 3,
+    SSBO_BOXES = 4,
+    SSBO_TEXTURE_RATIOS = 5,
+    // scene=instanced: InstanceForGLSL per instance and the TLAS boxes.
+    // Triangles and boxes of every mesh share bindings 3 and 4.
+    SSBO_INSTANCES = 6,
+    SSBO_TLAS_BOXES = 7,
+    // width=4 or width=8: WideBox nodes of the flat scene, root at 0
+    SSBO_WIDE_BOXES = 8,
+    // nodes=quantized: QuantizedBox nodes of the flat scene, root at 0
+    SSBO_QUANTIZED_BOXES = 9,
+    // traversal=stackless: StacklessLink per box of the flat scene
+    SSBO_STACKLESS_LINKS = 10,
+    // triangles=split: TriangleGeometry and TriangleAttributes per triangle
+    // of the flat scene, in place of binding 3
+    SSBO_TRIANGLE_GEOMETRY = 11,
+    SSBO_TRIANGLE_ATTRIBUTES = 12,
+    // triangles=indexed: the welded vertices and TriangleIndices per
+    // triangle, with the attributes of binding 12
+    SSBO_WELDED_VERTICES = 13,
+    SSBO_TRIANGLE_INDICES = 14,
+    // MaterialForGLSL per glTF material of the flat scene, indexed by the
+    // material_id of binding 3 or of the attributes of binding 12
+    SSBO_MATERIALS = 15,
+    // triangles=precomputed: TriangleEdges per triangle, in place of
+    // binding 11
+    SSBO_TRIANGLE_EDGES = 16,
+    // sbvh and clip=: uint per leaf reference of the flat scene, the index
+    // of its triangle in binding 3 or the streams that replace it
+    SSBO_REFERENCE_INDICES = 17,
+};
+
+struct SceneBuffers {
+    GLuint triangles;
+    GLuint boxes;
+    GLuint instances;
+    GLuint tlas;
+};
+
+// Buffers of the flat scene a refit rewrites: the triangles go to whichever
+// binding `triangles` uploads them to, the others stay 0
+struct FlatBuffers {
+    GLuint boxes;
+    GLuint triangles;
+    GLuint geometry;
+    GLuint edges;
+    GLuint welded_vertices;
+};
+
+// Buffers of a DynamicBVH, allocated with room to grow
+struct DynamicBuffers {
+    GLuint triangles;
+    GLuint boxes;
+    size_t triangle_capacity;
+    size_t box_capacity;
+};
+
+GLuint create_ssbo(GLuint binding, const void *data, size_t size);
+
+void update_ssbo(GLuint ssbo, size_t offset, const void *data, size_t size);
+
+// Replaces the whole contents, the size may change
+void replace_ssbo(GLuint ssbo, const void *data, size_t size);
+
+// Uploads the meshes, their BVHs, the instances and the TLAS of a built scene
+SceneBuffers create_scene_ssbos(const Scene &scene);
+
+// Re-uploads the instances and the TLAS after build_tlas; the meshes stay
+void upload_tlas(const SceneBuffers &buffers, const Scene &scene);
+
+// Re-uploads only the boxes and triangles a refit changed, the triangles
+// in the stream `triangle_streams` picks, with the `w` words of the split
+// streams taken from `materials`. triangles=indexed moves the welded
+// vertices of the moved triangles in `welded_vertices` first.
+void upload_refit(const FlatBuffers &buffers, int triangle_streams,
+                  const std::vector<TriangleForGLSL *> &triangles,
+                  const std::vector<MaterialForGLSL> &materials,
+                  const std::vector<TriangleIndices> &indices,
+                  std::vector<PaddedVec3ForGLSL> &welded_vertices,
+                  const std::vector<Box> &boxes, const RefitResult &result);
+
+// Uploads the triangles and boxes of `bvh` to bindings 3 and 4
+DynamicBuffers create_dynamic_ssbos(DynamicBVH &bvh);
+
+// Uploads what changed since the last upload. A buffer that outgrew its
+// capacity moves to a new one of twice the size, its contents copied on the
+// GPU, and is bound in its place; indices never move, so nothing else
+// changes.
+void upload_dynamic(DynamicBuffers &buffers, DynamicBVH &bvh);
+
+#endif // INCLUDE_SSBO_HPP_
@@ -0,0 +1,41 @@
+#ifndef INCLUDE_STACKLESS_HPP_
+#define INCLUDE_STACKLESS_HPP_
+#include "./aabb.hpp"
+#include "./ray.hpp"
+#include <cstdint>
+#include <vector>
+
+// Links of one box, stored at its box id next to the boxes. std430 layout:
+//
+//     int parent;   // -1 at the root
+//     int skip;     // next box after this subtree, -1 when there is none
+//
+// `skip` follows the left-first depth-first order: the right sibling of a
+// left child, otherwise the skip link of the parent. A shader walking
+// boxes[box].left_id on a hit and links[box].skip on a miss or after a leaf
+// visits the tree without a stack, ending at -1.
+struct StacklessLink {
+    int32_t parent;
+    int32_t skip;
+};
+
+// One link per entry of `boxes`; boxes outside the tree of `root_id` get -1
+std::vector<StacklessLink> stackless_links(const std::vector<Box> &boxes,
+                                           int root_id);
+
+// Left-first walk along the skip links, testing every box it enters
+Hit trace_bvh_skip(const std::vector<Box> &boxes, int root_id,
+                   const std::vector<StacklessLink> &links,
+                   const std::vector<TriangleForGLSL *> &triangles,
+                   const Ray &ray, TraversalStats &stats);
+
+// Nearest-child-first walk along the parent links (Hapala et al., "Efficient
+// Stack-less BVH Traversal for Ray Tracing"). The near child is the one
+// whose center lies further back along the ray, so it is found again when
+// the walk climbs back up.
+Hit trace_bvh_parent(const std::vector<Box> &boxes, int root_id,
+                     const std::vector<StacklessLink> &links,
+                     const std::vector<TriangleForGLSL *> &triangles,
+                     const Ray &ray, TraversalStats &stats);
+
+#endif // INCLUDE_STACKLESS_HPP_
@@ -0,0 +1,51 @@
+#ifndef INCLUDE_STATS_HPP_
+#define INCLUDE_STATS_HPP_
+#include "./aabb.hpp"
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Quality numbers of one tree, gathered in a single walk
+struct BVHStats {
+    float sah_cost = 0;
+    size_t nodes = 0;
+    size_t leaves = 0;
+    // Leaves by the number of triangles they hold
+    std::vector<size_t> leaf_fill;
+    // Leaves by depth, the root at depth 0
+    std::vector<size_t> leaf_depth;
+    // Summed area where siblings overlap, over the root area: how many
+    // boxes a ray through the root enters twice on average
+    float sibling_overlap = 0;
+    // Mean over the inner boxes of the overlap of their children over
+    // their own area
+    float mean_sibling_overlap = 0;
+    size_t node_bytes = 0;
+};
+
+struct FileStats {
+    std::string path;
+    size_t triangles;
+};
+
+struct SceneStats {
+    std::string builder;
+    BVHStats bvh;
+    // scene=instanced: the tree above is the TLAS, these are the meshes
+    std::vector<BVHStats> meshes;
+    size_t triangles = 0;
+    size_t triangle_bytes = 0;
+    size_t textures = 0;
+    size_t texture_bytes = 0;
+    std::vector<FileStats> files;
+};
+
+// `node_bytes` counts all of `boxes`, which may hold more than the tree;
+// callers add the other node buffers they upload
+BVHStats bvh_stats(const std::vector<Box> &boxes, int root_id,
+                   const BuildParams &params);
+
+void write_stats_json(std::ostream &out, const SceneStats &stats);
+
+#endif // INCLUDE_STATS_HPP_
@@ -0,0 +1,75 @@
+#ifndef INCLUDE_THREAD_POOL_HPP_
+#define INCLUDE_THREAD_POOL_HPP_
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TaskGroup {
+    std::atomic<int> pending{0};
+};
+
+struct Task {
+    std::function<void()> function;
+    TaskGroup *group;
+};
+
+struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+};
+
+// Work-stealing pool. Every worker pops its own queue from the back and
+// steals from the front of the others. The thread that waits on a group
+// executes tasks as well, so a pool of size 1 runs everything inline.
+class ThreadPool {
+  public:
+    explicit ThreadPool(int thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const;
+
+    void run(TaskGroup &group, std::function<void()> task);
+
+    void wait(TaskGroup &group);
+
+    // Calls function(i) for every i in [begin, end), `grain` indices per task
+    template <typename Function>
+    void parallel_for(int begin, int end, int grain, const Function &function) {
+        TaskGroup group;
+        grain = std::max(1, grain);
+        for (int chunk = begin; chunk < end; chunk += grain) {
+            int chunk_end = std::min(end, chunk + grain);
+            run(group, [chunk, chunk_end, &function]() {
+                for (int i = chunk; i < chunk_end; ++i) {
+                    function(i);
+                }
+            });
+        }
+        wait(group);
+    }
+
+  private:
+    bool run_one(int queue);
+    void worker_loop(int queue);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+};
+
+// Number of threads to use when none is given on the command line
+int default_thread_count();
+
+#endif // INCLUDE_THREAD_POOL_HPP_
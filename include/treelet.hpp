@@ -0,0 +1,24 @@
+#ifndef INCLUDE_TREELET_HPP_
+#define INCLUDE_TREELET_HPP_
+#include "./aabb.hpp"
+#include "./thread_pool.hpp"
+#include <vector>
+
+// Largest treelet restructured at once. Its topologies are searched over
+// every subset of its leaves, 3^n steps.
+const int TREELET_LEAVES = 7;
+
+// Post-pass over a tree from any builder (Karras and Aila, "Fast Parallel
+// Construction of High-Quality Bounding Volume Hierarchies"). Every pass
+// walks the tree bottom-up; at every node it grows a treelet of up to
+// TREELET_LEAVES leaves by opening the largest child and rebuilds the
+// treelet in the topology with the lowest SAH cost. Treelets of one height
+// are disjoint and run in parallel. The result is re-emitted into `boxes`
+// like `linearize_tree`, and `aabb` points at its root. Returns the SAH cost
+// before the first pass and after every pass.
+std::vector<float> optimize_treelets(std::vector<Box> &boxes,
+                                     std::vector<TriangleForGLSL *> &triangles,
+                                     AABB &aabb, const BuildParams &params,
+                                     int passes, ThreadPool &pool);
+
+#endif // INCLUDE_TREELET_HPP_
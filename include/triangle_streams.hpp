@@ -0,0 +1,146 @@
+#ifndef INCLUDE_TRIANGLE_STREAMS_HPP_
+#define INCLUDE_TRIANGLE_STREAMS_HPP_
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include "./material_table.hpp"
+#include "./ray.hpp"
+#include <cstdint>
+#include <vector>
+
+// How the flat scene triangles are uploaded. All of them go with the
+// material table of binding 15.
+enum {
+    // TriangleForGLSL to binding 3
+    TRIANGLES_FULL = 0,
+    // TriangleGeometry to binding 11, TriangleAttributes to binding 12
+    TRIANGLES_SPLIT = 1,
+    // Welded vertices to binding 13, TriangleIndices to binding 14, and
+    // the attributes as above
+    TRIANGLES_INDEXED = 2,
+    // TriangleEdges to binding 16, the attributes as above
+    TRIANGLES_PRECOMPUTED = 3,
+};
+
+// What the intersection test reads, 48 bytes instead of the 160 of
+// TriangleForGLSL. std430 layout:
+//
+//     vec4 v1;   // w: 1 for double-sided triangles, else 0
+//     vec4 v2;   // w: alpha cutoff of MASK materials, else 0. The
+//                //    attributes and material are read during traversal
+//                //    only when it is above 0
+//     vec4 v3;   // w: unused
+struct TriangleGeometry {
+    PaddedVec3ForGLSL v1;
+    PaddedVec3ForGLSL v2;
+    PaddedVec3ForGLSL v3;
+};
+
+// TriangleGeometry with the edges from the first vertex precomputed, so
+// the Möller-Trumbore test starts from them instead of subtracting the
+// vertices first. std430 layout:
+//
+//     vec4 v1;   // w: as in TriangleGeometry
+//     vec4 e1;   // v2 - v1, w: as in TriangleGeometry
+//     vec4 e2;   // v3 - v1, w: unused
+struct TriangleEdges {
+    PaddedVec3ForGLSL v1;
+    PaddedVec3ForGLSL e1;
+    PaddedVec3ForGLSL e2;
+};
+
+// What shading reads for the closest hit, at the same index, 32 bytes.
+// std430 layout:
+//
+//     vec2 uv1, uv2, uv3;
+//     uint material_id;   // into the MaterialForGLSL table of binding 15
+//     uint padding;
+struct TriangleAttributes {
+    Vec2ForGLSL uv1;
+    Vec2ForGLSL uv2;
+    Vec2ForGLSL uv3;
+    uint32_t material_id;
+    uint32_t padding;
+};
+
+// Bits of TriangleIndices::flags
+enum {
+    TRIANGLE_DOUBLE_SIDED = 1,
+    // MASK material, read from the material during traversal
+    TRIANGLE_ALPHA_TESTED = 2,
+};
+
+// Indices of the vertices of a triangle into the welded vertices, where
+// every vertex of the glTF index buffers is stored once per mesh instance
+// as a vec4 with w = 0. std430 layout: uvec4, the last word holds the
+// flags.
+struct TriangleIndices {
+    uint32_t v1;
+    uint32_t v2;
+    uint32_t v3;
+    uint32_t flags;
+};
+
+// The geometry stream entry of one triangle. The `w` words are taken from
+// its material in `materials`, the table its material_id indexes.
+TriangleGeometry triangle_geometry(
+    const TriangleForGLSL &triangle,
+    const std::vector<MaterialForGLSL> &materials);
+
+// The precomputed geometry stream entry of one triangle
+TriangleEdges triangle_edges(const TriangleForGLSL &triangle,
+                             const std::vector<MaterialForGLSL> &materials);
+
+// Fills both streams from `triangles`, in the same order. The attributes
+// keep the material_id of every triangle.
+void split_triangles(const std::vector<TriangleForGLSL *> &triangles,
+                     const std::vector<MaterialForGLSL> &materials,
+                     std::vector<TriangleGeometry> &geometry,
+                     std::vector<TriangleAttributes> &attributes);
+
+// split_triangles with the geometry stream in TriangleEdges form
+void precompute_triangles(const std::vector<TriangleForGLSL *> &triangles,
+                          const std::vector<MaterialForGLSL> &materials,
+                          std::vector<TriangleEdges> &edges,
+                          std::vector<TriangleAttributes> &attributes);
+
+// Welds the vertices of `triangles` back together by the ids
+// node_to_triangles kept from the glTF index buffers, `vertex_ids[i]` those
+// of `*triangles[i]`, so vertices that only share a position stay apart
+// along UV seams. `indices` and `attributes` keep the order of the
+// triangles, so the leaves of a tree built over them index both unchanged.
+// The flags are taken from the materials, as in triangle_geometry.
+void index_triangles(const std::vector<TriangleForGLSL *> &triangles,
+                     const std::vector<TriangleVertexIds> &vertex_ids,
+                     const std::vector<MaterialForGLSL> &materials,
+                     std::vector<PaddedVec3ForGLSL> &vertices,
+                     std::vector<TriangleIndices> &indices,
+                     std::vector<TriangleAttributes> &attributes);
+
+// CPU references of a shader finding the closest hit in the tree, then
+// reading the shading data of the hit. They read the uploaded triangle
+// array, or the geometry stream, its precomputed form, or the indices and
+// welded vertices, followed by the attributes and the material, which
+// alpha-tested candidates read as well. All count the distinct 64-byte
+// lines of triangle data every ray reads in `stats.triangle_lines`.
+Hit trace_full_triangles(const std::vector<Box> &boxes, int root_id,
+                         const std::vector<TriangleForGLSL> &triangles,
+                         const Ray &ray, TraversalStats &stats);
+
+Hit trace_split_triangles(const std::vector<Box> &boxes, int root_id,
+                          const std::vector<TriangleGeometry> &geometry,
+                          const std::vector<TriangleAttributes> &attributes,
+                          const Ray &ray, TraversalStats &stats);
+
+Hit trace_precomputed_triangles(
+    const std::vector<Box> &boxes, int root_id,
+    const std::vector<TriangleEdges> &edges,
+    const std::vector<TriangleAttributes> &attributes, const Ray &ray,
+    TraversalStats &stats);
+
+Hit trace_indexed_triangles(const std::vector<Box> &boxes, int root_id,
+                            const std::vector<PaddedVec3ForGLSL> &vertices,
+                            const std::vector<TriangleIndices> &indices,
+                            const std::vector<TriangleAttributes> &attributes,
+                            const Ray &ray, TraversalStats &stats);
+
+#endif // INCLUDE_TRIANGLE_STREAMS_HPP_
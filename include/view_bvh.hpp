@@ -0,0 +1,46 @@
+#ifndef INCLUDE_VIEW_BVH_HPP_
+#define INCLUDE_VIEW_BVH_HPP_
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include "./ray.hpp"
+#include "./thread_pool.hpp"
+#include <string>
+#include <vector>
+
+// Camera of the raytracer: the `position` and `rotation` uniforms
+struct CameraView {
+    PaddedVec3ForGLSL position;
+    float pitch;
+    float yaw;
+};
+
+// Views of the file at `path`, one `x y z pitch yaw` line each. Empty
+// lines and lines starting with # are skipped.
+std::vector<CameraView> load_views(const std::string &path);
+
+// Adds `view` as a line at the end of the file. Returns false when the
+// file cannot be written.
+bool append_view(const std::string &path, const CameraView &view);
+
+// Primary rays of a square image of `resolution` pixels per side from every
+// view, with the 45 degree field of view of the controls
+std::vector<Ray> view_rays(const std::vector<CameraView> &views,
+                           int resolution);
+
+// Rays spread evenly over the views, about `VIEW_SAMPLE_RAYS` in total and
+// at least 8 by 8 per view
+const int VIEW_SAMPLE_RAYS = 32768;
+std::vector<Ray> sample_view_rays(const std::vector<CameraView> &views);
+
+// Binned SAH builder that weighs every child by the share of `rays`
+// reaching it as well as by its area (Bittner and Havran, "RDH: Ray
+// Distribution Heuristics for Construction of Spatial Data Structures").
+// Rays end at their first hit, found with a SAH tree first, so geometry
+// the views never see costs little. Nodes too few rays reach fall back to
+// area alone. Emits the same post-order `Box` array as the other builders.
+AABB *triangles_to_aabb_views(std::vector<Box> &boxes,
+                              std::vector<TriangleForGLSL *> &triangles,
+                              const std::vector<Ray> &rays,
+                              const BuildParams &params, ThreadPool &pool);
+
+#endif // INCLUDE_VIEW_BVH_HPP_
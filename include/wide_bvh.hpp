@@ -0,0 +1,40 @@
+#ifndef INCLUDE_WIDE_BVH_HPP_
+#define INCLUDE_WIDE_BVH_HPP_
+#include "./aabb.hpp"
+#include "./ray.hpp"
+#include <vector>
+
+// Node of a BVH with up to N children, bounds stored per axis so a shader
+// tests all children with one fetch. std430 layout, N * 32 bytes:
+//
+//     float min_x[N], min_y[N], min_z[N], max_x[N], max_y[N], max_z[N];
+//     int child[N];
+//     int count[N];
+//
+// A child with count > 0 is a leaf over triangles [child, child + count),
+// count 0 is an inner node at index `child`, or an empty slot to skip when
+// child is -1.
+template <int N> struct WideBox {
+    float min_x[N];
+    float min_y[N];
+    float min_z[N];
+    float max_x[N];
+    float max_y[N];
+    float max_z[N];
+    int child[N];
+    int count[N];
+};
+
+// Collapses the binary tree into nodes of up to N children, the root at
+// index 0. Every node opens the inner child with the largest surface area
+// until it holds N children. Leaves keep the triangle order of `boxes`.
+template <int N>
+std::vector<WideBox<N>> collapse_bvh(const std::vector<Box> &boxes,
+                                     int root_id);
+
+template <int N>
+Hit trace_wide_bvh(const std::vector<WideBox<N>> &nodes,
+                   const std::vector<TriangleForGLSL *> &triangles,
+                   const Ray &ray, TraversalStats &stats);
+
+#endif // INCLUDE_WIDE_BVH_HPP_
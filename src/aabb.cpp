@@ -1,8 +1,15 @@
 #include "./aabb.hpp"
+#include "./early_split.hpp"
+#include "./lbvh.hpp"
 #include "./load_model.hpp"
+#include "./parallel_build.hpp"
+#include "./ploc.hpp"
+#include "./sah.hpp"
+#include "./sbvh.hpp"
 #include <algorithm>
 #include <iostream>
 #include <limits>
+#include <unordered_map>
 #include <vector>
 
 PaddedVec3ForGLSL get_min(const std::vector<TriangleForGLSL *> &triangles, int start,
@@ -43,12 +50,75 @@ float get_coord(int coord, const PaddedVec3ForGLSL &v) {
     }
 }
 
+void set_coord(int coord, PaddedVec3ForGLSL &v, float value) {
+    if (coord == 0) {
+        v.x = value;
+    } else if (coord == 1) {
+        v.y = value;
+    } else {
+        v.z = value;
+    }
+}
+
+Bounds empty_bounds() {
+    return Bounds{PaddedVec3ForGLSL{std::numeric_limits<float>::max(),
+                                    std::numeric_limits<float>::max(),
+                                    std::numeric_limits<float>::max(), 0},
+                  PaddedVec3ForGLSL{-std::numeric_limits<float>::max(),
+                                    -std::numeric_limits<float>::max(),
+                                    -std::numeric_limits<float>::max(), 0}};
+}
+
+Bounds merge_bounds(const Bounds &a, const Bounds &b) {
+    return Bounds{PaddedVec3ForGLSL{std::min(a.min.x, b.min.x),
+                                    std::min(a.min.y, b.min.y),
+                                    std::min(a.min.z, b.min.z), 0},
+                  PaddedVec3ForGLSL{std::max(a.max.x, b.max.x),
+                                    std::max(a.max.y, b.max.y),
+                                    std::max(a.max.z, b.max.z), 0}};
+}
+
+Bounds merge_bounds(const Bounds &a, const PaddedVec3ForGLSL &point) {
+    return merge_bounds(a, Bounds{point, point});
+}
+
+Bounds intersect_bounds(const Bounds &a, const Bounds &b) {
+    return Bounds{PaddedVec3ForGLSL{std::max(a.min.x, b.min.x),
+                                    std::max(a.min.y, b.min.y),
+                                    std::max(a.min.z, b.min.z), 0},
+                  PaddedVec3ForGLSL{std::min(a.max.x, b.max.x),
+                                    std::min(a.max.y, b.max.y),
+                                    std::min(a.max.z, b.max.z), 0}};
+}
+
+Bounds box_bounds(const Box &box) { return Bounds{box.min, box.max}; }
+
+Bounds triangle_bounds(const TriangleForGLSL &triangle) {
+    return Bounds{triangle.min, triangle.max};
+}
+
+PaddedVec3ForGLSL bounds_center(const Bounds &bounds) {
+    return PaddedVec3ForGLSL{(bounds.min.x + bounds.max.x) * 0.5f,
+                             (bounds.min.y + bounds.max.y) * 0.5f,
+                             (bounds.min.z + bounds.max.z) * 0.5f, 0};
+}
+
+float surface_area(const Bounds &bounds) {
+    float dx = bounds.max.x - bounds.min.x;
+    float dy = bounds.max.y - bounds.min.y;
+    float dz = bounds.max.z - bounds.min.z;
+    if (dx < 0 || dy < 0 || dz < 0) {
+        return 0;
+    }
+    return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
 Box triangles_to_box(std::vector<Box> &boxes,
                      std::vector<TriangleForGLSL *> &triangles, int start,
-                     int end, int coord) {
+                     int end, int coord, int leaf_size) {
     int span = end - start;
 
-    if (span <= 8) {
+    if (span <= leaf_size) {
         return Box(get_min(triangles, start, end),
                    get_max(triangles, start, end), -1, -1, start, end);
     }
@@ -61,11 +131,11 @@ Box triangles_to_box(std::vector<Box> &boxes,
             return get_coord(coord, a->min) < get_coord(coord, b->min);
         });
 
-    boxes.emplace_back(
-        triangles_to_box(boxes, triangles, start, mid, get_next_coord(coord)));
+    boxes.emplace_back(triangles_to_box(boxes, triangles, start, mid,
+                                        get_next_coord(coord), leaf_size));
     int left = boxes.size() - 1;
-    boxes.emplace_back(
-        triangles_to_box(boxes, triangles, mid, end, get_next_coord(coord)));
+    boxes.emplace_back(triangles_to_box(boxes, triangles, mid, end,
+                                        get_next_coord(coord), leaf_size));
     int right = boxes.size() - 1;
 
     return Box(PaddedVec3ForGLSL{std::min(boxes[left].min.x, boxes[right].min.x),
@@ -79,19 +149,194 @@ Box triangles_to_box(std::vector<Box> &boxes,
 
 AABB *triangles_to_aabb(std::vector<Box> &boxes,
                         std::vector<TriangleForGLSL *> &triangles, int start,
-                        int end, int coord) {
+                        int end, int coord, int leaf_size) {
     int span = end - start;
 
-    if (span <= 8) {
+    if (span <= leaf_size) {
         PaddedVec3ForGLSL min = get_min(triangles, start, end);
         PaddedVec3ForGLSL max = get_max(triangles, start, end);
         boxes.emplace_back(Box(min, max, -1, -1, start, end));
         return new AABB{static_cast<int>(boxes.size() - 1)};
     }
-    boxes.emplace_back(triangles_to_box(boxes, triangles, start, end, coord));
+    boxes.emplace_back(
+        triangles_to_box(boxes, triangles, start, end, coord, leaf_size));
     return new AABB{static_cast<int>(boxes.size() - 1)};
 }
 
+int count_boxes(int span, int leaf_size,
+                std::unordered_map<int, int> &counts) {
+    if (span <= leaf_size) {
+        return 1;
+    }
+    auto found = counts.find(span);
+    if (found != counts.end()) {
+        return found->second;
+    }
+    int count = 1 + count_boxes(span / 2, leaf_size, counts) +
+                count_boxes(span - span / 2, leaf_size, counts);
+    counts[span] = count;
+    return count;
+}
+
+int count_boxes(int span, int leaf_size) {
+    // Both halves of a median split differ by at most one triangle, so only
+    // two distinct spans exist per level
+    std::unordered_map<int, int> counts;
+    return count_boxes(span, leaf_size, counts);
+}
+
+struct LinearizeState {
+    const std::vector<Box> &nodes;
+    const std::vector<TriangleForGLSL *> &triangles;
+    const std::vector<bool> &collapse;
+    std::vector<Box> &boxes;
+    std::vector<TriangleForGLSL *> &ordered;
+};
+
+void gather_triangles(LinearizeState &state, int node_id) {
+    const Box &node = state.nodes[node_id];
+    if (node.left_id == -1) {
+        for (int i = node.start; i < node.end; i++) {
+            state.ordered.push_back(state.triangles[i]);
+        }
+        return;
+    }
+    gather_triangles(state, node.left_id);
+    gather_triangles(state, node.right_id);
+}
+
+Box linearize_node(LinearizeState &state, int node_id) {
+    const Box &node = state.nodes[node_id];
+    int start = state.ordered.size();
+    if (node.left_id == -1 || state.collapse[node_id]) {
+        gather_triangles(state, node_id);
+        return Box(node.min, node.max, -1, -1, start, state.ordered.size());
+    }
+    state.boxes.emplace_back(linearize_node(state, node.left_id));
+    int left = state.boxes.size() - 1;
+    state.boxes.emplace_back(linearize_node(state, node.right_id));
+    int right = state.boxes.size() - 1;
+    return Box(node.min, node.max, left, right, start, state.ordered.size());
+}
+
+AABB *linearize_tree(std::vector<Box> &boxes,
+                     std::vector<TriangleForGLSL *> &triangles,
+                     const std::vector<Box> &nodes, int root_id,
+                     const BuildParams &params) {
+    // Children first: triangle count and SAH cost (not divided by the root
+    // area) of every subtree decide which ones collapse into a leaf
+    std::vector<int> counts(nodes.size());
+    std::vector<float> costs(nodes.size());
+    std::vector<bool> collapse(nodes.size());
+    std::vector<std::pair<int, bool>> stack = {{root_id, false}};
+    while (!stack.empty()) {
+        auto [node_id, children_done] = stack.back();
+        stack.pop_back();
+        const Box &node = nodes[node_id];
+        float area = surface_area(box_bounds(node));
+        if (node.left_id == -1) {
+            counts[node_id] = node.end - node.start;
+            costs[node_id] = params.intersection_cost * area * counts[node_id];
+            continue;
+        }
+        if (!children_done) {
+            stack.push_back({node_id, true});
+            stack.push_back({node.left_id, false});
+            stack.push_back({node.right_id, false});
+            continue;
+        }
+        counts[node_id] = counts[node.left_id] + counts[node.right_id];
+        float split_cost = params.traversal_cost * area +
+                           costs[node.left_id] + costs[node.right_id];
+        float leaf_cost = params.intersection_cost * area * counts[node_id];
+        collapse[node_id] =
+            counts[node_id] <= params.leaf_size && leaf_cost <= split_cost;
+        costs[node_id] = collapse[node_id] ? leaf_cost : split_cost;
+    }
+
+    std::vector<TriangleForGLSL *> ordered;
+    ordered.reserve(triangles.size());
+    LinearizeState state{nodes, triangles, collapse, boxes, ordered};
+    boxes.emplace_back(linearize_node(state, root_id));
+    triangles.swap(ordered);
+    return new AABB{static_cast<int>(boxes.size() - 1)};
+}
+
+AABB *build_aabb(std::vector<Box> &boxes,
+                 std::vector<TriangleForGLSL *> &triangles, int builder,
+                 const BuildParams &params, ThreadPool &pool) {
+    if (params.clip_budget > 0) {
+        return build_clipped(
+            triangles, params,
+            [&](std::vector<TriangleForGLSL *> &references,
+                const BuildParams &unclipped) {
+                return build_aabb(boxes, references, builder, unclipped,
+                                  pool);
+            });
+    }
+    switch (builder) {
+    case BUILDER_SAH:
+        return triangles_to_aabb_sah(boxes, triangles, params);
+    case BUILDER_SBVH:
+        return triangles_to_aabb_sbvh(boxes, triangles, params);
+    case BUILDER_LBVH:
+        return triangles_to_aabb_lbvh(boxes, triangles, params, pool);
+    case BUILDER_PLOC:
+        return triangles_to_aabb_ploc(boxes, triangles, params, pool);
+    default:
+        return triangles_to_aabb_parallel(boxes, triangles, params, pool);
+    }
+}
+
+const char *builder_name(int builder) {
+    switch (builder) {
+    case BUILDER_SAH:
+        return "sah";
+    case BUILDER_SBVH:
+        return "sbvh";
+    case BUILDER_LBVH:
+        return "lbvh";
+    case BUILDER_PLOC:
+        return "ploc";
+    default:
+        return "median";
+    }
+}
+
+int find_builder(const std::string &name) {
+    for (int builder = 0; builder < BUILDER_COUNT; ++builder) {
+        if (name == builder_name(builder)) {
+            return builder;
+        }
+    }
+    return -1;
+}
+
+float sah_cost(const std::vector<Box> &boxes, int root_id,
+               const BuildParams &params) {
+    float root_area = surface_area(box_bounds(boxes[root_id]));
+    if (root_area <= 0) {
+        return params.intersection_cost *
+               (boxes[root_id].end - boxes[root_id].start);
+    }
+    // Walk with an explicit stack: degenerate trees can be very deep
+    float cost = 0;
+    std::vector<int> stack = {root_id};
+    while (!stack.empty()) {
+        const Box &box = boxes[stack.back()];
+        stack.pop_back();
+        float area = surface_area(box_bounds(box));
+        if (box.left_id == -1) {
+            cost += area * params.intersection_cost * (box.end - box.start);
+            continue;
+        }
+        cost += area * params.traversal_cost;
+        stack.push_back(box.left_id);
+        stack.push_back(box.right_id);
+    }
+    return cost / root_area;
+}
+
 void print_box(std::vector<Box> boxes, int box_id, size_t depth,
                std::vector<TriangleForGLSL *> &triangles) {
     for (size_t i = 0; i < depth; ++i) {
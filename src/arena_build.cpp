@@ -0,0 +1,85 @@
+#include "./arena_build.hpp"
+#include "./aabb.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+struct MedianRange {
+    int start;
+    int end;
+    int coord;
+    int first_slot;
+};
+
+void fill_median_slots(std::vector<Box> &boxes,
+                       std::vector<TriangleForGLSL *> &triangles, int start,
+                       int end, int coord, int first_slot, int leaf_size) {
+    // Spans repeat across the tree, two per level
+    std::unordered_map<int, int> counts;
+    int slot_count = count_boxes(end - start, leaf_size, counts);
+    std::vector<MedianRange> stack = {{start, end, coord, first_slot}};
+    while (!stack.empty()) {
+        MedianRange range = stack.back();
+        stack.pop_back();
+        int span = range.end - range.start;
+        if (span <= leaf_size) {
+            Bounds bounds = empty_bounds();
+            for (int i = range.start; i < range.end; i++) {
+                bounds = merge_bounds(bounds, triangle_bounds(*triangles[i]));
+            }
+            boxes[range.first_slot] =
+                Box(bounds.min, bounds.max, -1, -1, range.start, range.end);
+            continue;
+        }
+
+        int mid = range.start + span / 2;
+        // A member pointer rather than get_coord, which cannot be inlined
+        // from here into the comparisons
+        float PaddedVec3ForGLSL::*axis =
+            range.coord == 0   ? &PaddedVec3ForGLSL::x
+            : range.coord == 1 ? &PaddedVec3ForGLSL::y
+                               : &PaddedVec3ForGLSL::z;
+        std::nth_element(
+            triangles.begin() + range.start, triangles.begin() + mid,
+            triangles.begin() + range.end,
+            [axis](const TriangleForGLSL *a, const TriangleForGLSL *b) {
+                return a->min.*axis < b->min.*axis;
+            });
+
+        int right_slot = range.first_slot +
+                         count_boxes(mid - range.start, leaf_size, counts);
+        int right =
+            right_slot + count_boxes(range.end - mid, leaf_size, counts) - 1;
+        // Bounds are merged below, once both children are written
+        boxes[right + 1].left_id = right_slot - 1;
+        boxes[right + 1].right_id = right;
+        boxes[right + 1].start = range.start;
+        boxes[right + 1].end = range.end;
+        int next = get_next_coord(range.coord);
+        stack.push_back({mid, range.end, next, right_slot});
+        stack.push_back({range.start, mid, next, range.first_slot});
+    }
+
+    // Post-order puts every child before its parent
+    for (int slot = first_slot; slot < first_slot + slot_count; ++slot) {
+        Box &box = boxes[slot];
+        if (box.left_id != -1) {
+            Bounds bounds = merge_bounds(box_bounds(boxes[box.left_id]),
+                                         box_bounds(boxes[box.right_id]));
+            box.min = bounds.min;
+            box.max = bounds.max;
+        }
+    }
+}
+
+AABB *triangles_to_aabb_arena(std::vector<Box> &boxes,
+                              std::vector<TriangleForGLSL *> &triangles,
+                              const BuildParams &params) {
+    int first_slot = boxes.size();
+    int count = count_boxes(triangles.size(), params.leaf_size);
+    PaddedVec3ForGLSL zero{0, 0, 0, 0};
+    boxes.resize(first_slot + count, Box(zero, zero, -1, -1, 0, 0));
+    fill_median_slots(boxes, triangles, 0, triangles.size(), 0, first_slot,
+                      params.leaf_size);
+    return new AABB{first_slot + count - 1};
+}
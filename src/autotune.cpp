@@ -0,0 +1,203 @@
+#include "./autotune.hpp"
+#include "./aabb.hpp"
+#include "./ray.hpp"
+#include "./thread_pool.hpp"
+#include "./wide_bvh.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+const int AUTOTUNE_VIEW_RESOLUTION = 64;
+// The fastest pass counts, the others absorb warm-up and noise
+const int AUTOTUNE_PASSES = 3;
+const int AUTOTUNE_RAY_GRAIN = 256;
+const int AUTOTUNE_LEAF_SIZES[] = {1, 2, 4, 8, 16};
+const float AUTOTUNE_TRAVERSAL_COSTS[] = {0.5f, 1.0f, 2.0f};
+const int AUTOTUNE_WIDTHS[] = {2, 4, 8};
+
+PaddedVec3ForGLSL normalized(const PaddedVec3ForGLSL &v) {
+    float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    return PaddedVec3ForGLSL{v.x / length, v.y / length, v.z / length, 0};
+}
+
+PaddedVec3ForGLSL cross(const PaddedVec3ForGLSL &a,
+                        const PaddedVec3ForGLSL &b) {
+    return PaddedVec3ForGLSL{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+                             a.x * b.y - a.y * b.x, 0};
+}
+
+std::vector<Ray>
+autotune_rays(const std::vector<TriangleForGLSL *> &triangles) {
+    Bounds scene = empty_bounds();
+    for (const auto *triangle : triangles) {
+        scene = merge_bounds(scene, triangle_bounds(*triangle));
+    }
+    PaddedVec3ForGLSL center = bounds_center(scene);
+    PaddedVec3ForGLSL half{(scene.max.x - scene.min.x) * 0.5f,
+                           (scene.max.y - scene.min.y) * 0.5f,
+                           (scene.max.z - scene.min.z) * 0.5f, 0};
+    // 60 degree field of view
+    float tan_half_fov = std::tan(0.5236f);
+
+    std::vector<Ray> rays;
+    int resolution = AUTOTUNE_VIEW_RESOLUTION;
+    rays.reserve(8 * resolution * resolution);
+    // One camera towards every corner of the bounds, looking at the centre
+    for (int corner = 0; corner < 8; ++corner) {
+        float distance = corner % 2 == 0 ? 0.5f : 1.5f;
+        PaddedVec3ForGLSL eye{
+            center.x + (corner & 1 ? 1 : -1) * half.x * distance,
+            center.y + (corner & 2 ? 1 : -1) * half.y * distance,
+            center.z + (corner & 4 ? 1 : -1) * half.z * distance, 0};
+        PaddedVec3ForGLSL forward = normalized(PaddedVec3ForGLSL{
+            center.x - eye.x, center.y - eye.y, center.z - eye.z, 0});
+        if (!std::isfinite(forward.x)) {
+            forward = PaddedVec3ForGLSL{0, 0, -1, 0};
+        }
+        PaddedVec3ForGLSL right =
+            normalized(cross(forward, PaddedVec3ForGLSL{0, 1, 0, 0}));
+        if (!std::isfinite(right.x)) {
+            right = PaddedVec3ForGLSL{1, 0, 0, 0};
+        }
+        PaddedVec3ForGLSL up = cross(right, forward);
+        for (int y = 0; y < resolution; ++y) {
+            for (int x = 0; x < resolution; ++x) {
+                float u = ((x + 0.5f) / resolution * 2 - 1) * tan_half_fov;
+                float v = ((y + 0.5f) / resolution * 2 - 1) * tan_half_fov;
+                rays.push_back(make_ray(
+                    eye, normalized(PaddedVec3ForGLSL{
+                             forward.x + u * right.x + v * up.x,
+                             forward.y + u * right.y + v * up.y,
+                             forward.z + u * right.z + v * up.z, 0})));
+            }
+        }
+    }
+    return rays;
+}
+
+double milliseconds_between(std::chrono::steady_clock::time_point start,
+                            std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Fastest of AUTOTUNE_PASSES traces of every ray, spread over the pool
+template <typename Trace>
+double time_trace(const std::vector<Ray> &rays, ThreadPool &pool,
+                  const Trace &trace) {
+    double best = std::numeric_limits<double>::max();
+    for (int pass = 0; pass < AUTOTUNE_PASSES; ++pass) {
+        auto start = std::chrono::steady_clock::now();
+        pool.parallel_for(0, rays.size(), AUTOTUNE_RAY_GRAIN, [&](int i) {
+            TraversalStats stats;
+            trace(rays[i], stats);
+        });
+        best = std::min(best, milliseconds_between(
+                                  start, std::chrono::steady_clock::now()));
+    }
+    return best;
+}
+
+// The median and lbvh builders split without looking at the SAH costs
+bool uses_sah_costs(int builder) {
+    return builder == BUILDER_SAH || builder == BUILDER_SBVH ||
+           builder == BUILDER_PLOC;
+}
+
+std::vector<TuneCandidate>
+autotune(const std::vector<TriangleForGLSL *> &triangles, int builder,
+         const BuildParams &params, const std::vector<Ray> &rays,
+         ThreadPool &pool) {
+    std::vector<TuneCandidate> candidates;
+    for (int leaf_size : AUTOTUNE_LEAF_SIZES) {
+        for (float traversal_cost : AUTOTUNE_TRAVERSAL_COSTS) {
+            if (!uses_sah_costs(builder) && traversal_cost != 1.0f) {
+                continue;
+            }
+            BuildParams candidate = params;
+            candidate.leaf_size = leaf_size;
+            candidate.traversal_cost = traversal_cost;
+            candidate.intersection_cost = 1.0f;
+
+            std::vector<Box> boxes;
+            std::vector<TriangleForGLSL *> ordered = triangles;
+            auto start = std::chrono::steady_clock::now();
+            AABB *aabb = build_aabb(boxes, ordered, builder, candidate, pool);
+            double build_ms = milliseconds_between(
+                start, std::chrono::steady_clock::now());
+            int root_id = aabb->root_id;
+            delete aabb;
+            // Measured with the given costs so candidates compare
+            float cost = sah_cost(boxes, root_id, params);
+
+            for (int width : AUTOTUNE_WIDTHS) {
+                double trace_ms = 0;
+                if (width == 4) {
+                    std::vector<WideBox<4>> wide =
+                        collapse_bvh<4>(boxes, root_id);
+                    trace_ms = time_trace(
+                        rays, pool, [&](const Ray &ray, TraversalStats &stats) {
+                            return trace_wide_bvh(wide, ordered, ray, stats);
+                        });
+                } else if (width == 8) {
+                    std::vector<WideBox<8>> wide =
+                        collapse_bvh<8>(boxes, root_id);
+                    trace_ms = time_trace(
+                        rays, pool, [&](const Ray &ray, TraversalStats &stats) {
+                            return trace_wide_bvh(wide, ordered, ray, stats);
+                        });
+                } else {
+                    trace_ms = time_trace(
+                        rays, pool, [&](const Ray &ray, TraversalStats &stats) {
+                            return trace_bvh(boxes, root_id, ordered, ray,
+                                             stats);
+                        });
+                }
+                candidates.push_back(
+                    TuneCandidate{candidate, width, build_ms, trace_ms, cost});
+            }
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const TuneCandidate &a, const TuneCandidate &b) {
+                         return a.trace_ms < b.trace_ms;
+                     });
+    return candidates;
+}
+
+std::string default_profile_path() {
+    const char *config = std::getenv("XDG_CONFIG_HOME");
+    if (config != nullptr && *config != '\0') {
+        return std::string(config) + "/myownraytracer/profile";
+    }
+    const char *home = std::getenv("HOME");
+    if (home != nullptr && *home != '\0') {
+        return std::string(home) + "/.config/myownraytracer/profile";
+    }
+    return "";
+}
+
+bool save_profile(const std::string &path, const TuneCandidate &best,
+                  int builder) {
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(parent, error);
+    }
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    file << "# Written by bench=autotune\n"
+         << "builder=" << builder_name(builder) << "\n"
+         << "leaf=" << best.params.leaf_size << "\n"
+         << "traversal_cost=" << best.params.traversal_cost << "\n"
+         << "intersection_cost=" << best.params.intersection_cost << "\n"
+         << "width=" << best.bvh_width << "\n";
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,857 @@
+#include "./benchmark.hpp"
+#include "./aabb.hpp"
+#include "./arena_build.hpp"
+#include "./autotune.hpp"
+#include "./dynamic_bvh.hpp"
+#include "./parallel_build.hpp"
+#include "./layout.hpp"
+#include "./quantized_bvh.hpp"
+#include "./ray.hpp"
+#include "./refit.hpp"
+#include "./sah.hpp"
+#include "./stackless.hpp"
+#include "./wide_bvh.hpp"
+#include "./thread_pool.hpp"
+#include "./treelet.hpp"
+#include "./triangle_streams.hpp"
+#include "./view_bvh.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+bool same_boxes(const std::vector<Box> &a, const std::vector<Box> &b) {
+    return a.size() == b.size() &&
+           std::memcmp(a.data(), b.data(), a.size() * sizeof(Box)) == 0;
+}
+
+// Median build time for 1..options.threads threads, checked against the
+// single-threaded tree
+void benchmark_threads(const std::vector<TriangleForGLSL *> &triangles,
+                       const Options &options) {
+    BuildParams params;
+    std::vector<Box> reference_boxes;
+    std::vector<TriangleForGLSL *> reference_triangles = triangles;
+    double single_thread_ms = 0;
+    std::cout << "threads  build ms  speedup  identical" << std::endl;
+    for (int threads = 1; threads <= options.threads; ++threads) {
+        ThreadPool pool(threads);
+        std::vector<Box> boxes;
+        std::vector<TriangleForGLSL *> ordered = triangles;
+        auto start = std::chrono::steady_clock::now();
+        AABB *aabb = triangles_to_aabb_parallel(boxes, ordered, params, pool);
+        double ms = milliseconds_since(start);
+        delete aabb;
+        if (threads == 1) {
+            single_thread_ms = ms;
+            reference_boxes = boxes;
+            reference_triangles = ordered;
+        }
+        bool identical = same_boxes(boxes, reference_boxes) &&
+                         ordered == reference_triangles;
+        std::cout << std::setw(7) << threads << std::setw(10) << std::fixed
+                  << std::setprecision(1) << ms << std::setw(9)
+                  << std::setprecision(2) << single_thread_ms / ms
+                  << std::setw(11) << (identical ? "yes" : "NO") << std::endl;
+    }
+}
+
+// Value in KB of a line like "VmRSS:  1234 kB" of /proc/self/status, 0
+// where there is none
+long status_kb(const std::string &key) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind(key + ":", 0) == 0) {
+            return std::atol(line.c_str() + key.size() + 1);
+        }
+    }
+    return 0;
+}
+
+// Resident memory `build` adds at its peak, in KB, measured by resetting
+// the high-water mark of the process. 0 without Linux /proc.
+template <typename Build> long peak_memory_kb(const Build &build) {
+#ifdef __GLIBC__
+    // A fixed threshold keeps large blocks in their own mappings, returned
+    // on free, instead of reusing pages earlier runs left resident
+    mallopt(M_MMAP_THRESHOLD, 128 * 1024);
+#endif
+    std::ofstream("/proc/self/clear_refs") << "5";
+    long before = status_kb("VmRSS");
+    build();
+    return std::max(0L, status_kb("VmHWM") - before);
+}
+
+// Build time and memory of the recursive median builder, which grows the
+// box array as it goes, against the parallel and the non-recursive arena
+// builders, which size it once
+void benchmark_arena(const std::vector<TriangleForGLSL *> &triangles,
+                     const Options &options) {
+    ThreadPool pool(options.threads);
+    const BuildParams &params = options.build_params;
+    std::vector<Box> reference_boxes;
+    std::vector<TriangleForGLSL *> reference_triangles;
+    std::cout << "builder     build ms   nodes KB    peak KB  identical"
+              << std::endl;
+    for (const char *name : {"recursive", "parallel", "arena"}) {
+        std::vector<Box> boxes;
+        std::vector<TriangleForGLSL *> ordered = triangles;
+        double ms = 0;
+        long peak_kb = peak_memory_kb([&]() {
+            auto start = std::chrono::steady_clock::now();
+            AABB *aabb;
+            if (std::strcmp(name, "recursive") == 0) {
+                aabb = triangles_to_aabb(boxes, ordered, 0, ordered.size(), 0,
+                                         params.leaf_size);
+            } else if (std::strcmp(name, "parallel") == 0) {
+                aabb = triangles_to_aabb_parallel(boxes, ordered, params,
+                                                  pool);
+            } else {
+                aabb = triangles_to_aabb_arena(boxes, ordered, params);
+            }
+            ms = milliseconds_since(start);
+            delete aabb;
+        });
+        if (reference_boxes.empty()) {
+            reference_boxes = boxes;
+            reference_triangles = ordered;
+        }
+        bool identical = same_boxes(boxes, reference_boxes) &&
+                         ordered == reference_triangles;
+        std::cout << std::left << std::setw(10) << name << std::right
+                  << std::fixed << std::setprecision(1) << std::setw(11) << ms
+                  << std::setw(11) << boxes.capacity() * sizeof(Box) / 1024
+                  << std::setw(11) << peak_kb << std::setw(11)
+                  << (identical ? "yes" : "NO") << std::endl;
+    }
+}
+
+// Build time, throughput and tree quality of every builder on the scene
+void benchmark_builders(const std::vector<TriangleForGLSL *> &triangles,
+                        const Options &options) {
+    ThreadPool pool(options.threads);
+    std::cout << "builder   build ms    Mtri/s     nodes  references  "
+                 "SAH cost"
+              << std::endl;
+    for (int builder = 0; builder < BUILDER_COUNT; ++builder) {
+        std::vector<Box> boxes;
+        std::vector<TriangleForGLSL *> ordered = triangles;
+        auto start = std::chrono::steady_clock::now();
+        AABB *aabb =
+            build_aabb(boxes, ordered, builder, options.build_params, pool);
+        double ms = milliseconds_since(start);
+        std::cout << std::left << std::setw(8) << builder_name(builder)
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << ms << std::setw(10)
+                  << std::setprecision(2) << triangles.size() / (ms * 1000.0)
+                  << std::setw(10) << boxes.size() << std::setw(12)
+                  << ordered.size() << std::setw(10)
+                  << sah_cost(boxes, aabb->root_id, options.build_params)
+                  << std::endl;
+        delete aabb;
+    }
+}
+
+// Refit time and tree quality against a full rebuild while the scene waves
+void benchmark_refit(const std::vector<TriangleForGLSL *> &triangles,
+                     const Options &options) {
+    int builder = options.builder == BUILDER_SBVH ? BUILDER_MEDIAN
+                                                  : options.builder;
+    ThreadPool pool(options.threads);
+    std::vector<TriangleForGLSL> rest(triangles.size());
+    std::vector<TriangleForGLSL> animated(triangles.size());
+    std::vector<TriangleForGLSL *> ordered(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        rest[i] = *triangles[i];
+        animated[i] = *triangles[i];
+        ordered[i] = &animated[i];
+    }
+    std::vector<Box> boxes;
+    AABB *aabb =
+        build_aabb(boxes, ordered, builder, options.build_params, pool);
+    RefitPlan plan = make_refit_plan(boxes, aabb->root_id);
+
+    Bounds scene = empty_bounds();
+    for (const auto &triangle : rest) {
+        scene = merge_bounds(scene, triangle_bounds(triangle));
+    }
+    float size = std::max(scene.max.x - scene.min.x, 1e-6f);
+    std::cout << "builder " << builder_name(builder) << std::endl
+              << "frame  amplitude  refit ms  rebuild ms  dirty boxes  "
+                 "refit SAH  rebuild SAH"
+              << std::endl;
+    // Positions are passed in the triangle order of the tree
+    std::vector<TriangleForGLSL> ordered_rest(ordered.size());
+    for (size_t i = 0; i < ordered.size(); ++i) {
+        ordered_rest[i] = rest[ordered[i] - animated.data()];
+    }
+    for (int frame = 1; frame <= 8; ++frame) {
+        float amplitude = size * 0.02f * frame;
+        std::vector<PaddedVec3ForGLSL> positions =
+            wave_positions(ordered_rest, amplitude, size / 8, frame * 0.5f);
+
+        auto start = std::chrono::steady_clock::now();
+        RefitResult result = refit_aabb(boxes, ordered, positions, plan, pool);
+        double refit_ms = milliseconds_since(start);
+
+        std::vector<Box> rebuilt;
+        std::vector<TriangleForGLSL *> rebuilt_order = ordered;
+        start = std::chrono::steady_clock::now();
+        AABB *rebuilt_aabb = build_aabb(rebuilt, rebuilt_order, builder,
+                                        options.build_params, pool);
+        double rebuild_ms = milliseconds_since(start);
+
+        std::cout << std::setw(5) << frame << std::fixed
+                  << std::setprecision(3) << std::setw(11) << amplitude
+                  << std::setprecision(1) << std::setw(10) << refit_ms
+                  << std::setw(12) << rebuild_ms << std::setw(13)
+                  << range_size(result.boxes)
+                  << std::setw(11)
+                  << sah_cost(boxes, aabb->root_id, options.build_params)
+                  << std::setw(13)
+                  << sah_cost(rebuilt, rebuilt_aabb->root_id,
+                              options.build_params)
+                  << std::endl;
+        delete rebuilt_aabb;
+    }
+    delete aabb;
+}
+
+const int BENCHMARK_RAY_COUNT = 200000;
+
+// Rays from random points inside the scene in random directions
+std::vector<Ray> benchmark_rays(const std::vector<TriangleForGLSL *> &triangles,
+                                int count) {
+    Bounds scene = empty_bounds();
+    for (const auto *triangle : triangles) {
+        scene = merge_bounds(scene, triangle_bounds(*triangle));
+    }
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0, 1);
+    std::normal_distribution<float> normal;
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        PaddedVec3ForGLSL origin{
+            scene.min.x + (scene.max.x - scene.min.x) * unit(random),
+            scene.min.y + (scene.max.y - scene.min.y) * unit(random),
+            scene.min.z + (scene.max.z - scene.min.z) * unit(random), 0};
+        PaddedVec3ForGLSL direction{normal(random), normal(random),
+                                    normal(random), 0};
+        rays.push_back(make_ray(origin, direction));
+    }
+    return rays;
+}
+
+// Traces every ray with `trace` and prints one row of a layout table, with
+// the number of rays whose closest hit differs from `reference`
+template <typename Trace>
+std::vector<Hit> report_traversal(const char *layout, size_t nodes,
+                                  size_t bytes, const std::vector<Ray> &rays,
+                                  const std::vector<Hit> &reference,
+                                  const Trace &trace) {
+    TraversalStats stats;
+    std::vector<Hit> hits(rays.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rays.size(); ++i) {
+        hits[i] = trace(rays[i], stats);
+    }
+    double ms = milliseconds_since(start);
+    int mismatches = 0;
+    for (size_t i = 0; i < reference.size(); ++i) {
+        mismatches += hits[i].t != reference[i].t;
+    }
+    double count = rays.size();
+    std::cout << std::left << std::setw(10) << layout << std::right
+              << std::setw(10) << nodes << std::setw(12) << bytes / 1024
+              << std::fixed << std::setprecision(1) << std::setw(10)
+              << stats.nodes / count << std::setw(10) << stats.boxes / count
+              << std::setw(10) << stats.triangles / count << std::setw(10)
+              << ms << std::setw(12) << mismatches << std::endl;
+    return hits;
+}
+
+void print_traversal_header(size_t ray_count) {
+    std::cout << ray_count << " rays, averages per ray" << std::endl
+              << "layout       nodes   memory KB     steps     boxes "
+                 "triangles  trace ms  mismatches"
+              << std::endl;
+}
+
+// Node count, memory and traversal work of the binary tree against its
+// 4- and 8-wide collapses
+void benchmark_wide(const std::vector<TriangleForGLSL *> &triangles,
+                    const Options &options) {
+    ThreadPool pool(options.threads);
+    std::vector<Box> boxes;
+    std::vector<TriangleForGLSL *> ordered = triangles;
+    AABB *aabb = build_aabb(boxes, ordered, options.builder,
+                            options.build_params, pool);
+    int root_id = aabb->root_id;
+    delete aabb;
+    std::vector<WideBox<4>> wide4 = collapse_bvh<4>(boxes, root_id);
+    std::vector<WideBox<8>> wide8 = collapse_bvh<8>(boxes, root_id);
+    std::vector<Ray> rays = benchmark_rays(triangles, BENCHMARK_RAY_COUNT);
+
+    std::cout << "builder " << builder_name(options.builder) << std::endl;
+    print_traversal_header(rays.size());
+    std::vector<Hit> reference = report_traversal(
+        "binary", boxes.size(), boxes.size() * sizeof(Box), rays, {},
+        [&](const Ray &ray, TraversalStats &stats) {
+            return trace_bvh(boxes, root_id, ordered, ray, stats);
+        });
+    report_traversal("wide4", wide4.size(), wide4.size() * sizeof(WideBox<4>),
+                     rays, reference,
+                     [&](const Ray &ray, TraversalStats &stats) {
+                         return trace_wide_bvh(wide4, ordered, ray, stats);
+                     });
+    report_traversal("wide8", wide8.size(), wide8.size() * sizeof(WideBox<8>),
+                     rays, reference,
+                     [&](const Ray &ray, TraversalStats &stats) {
+                         return trace_wide_bvh(wide8, ordered, ray, stats);
+                     });
+}
+
+// Memory and traversal work of the full-precision tree against its 8-bit
+// quantized encoding
+void benchmark_quantized(const std::vector<TriangleForGLSL *> &triangles,
+                         const Options &options) {
+    ThreadPool pool(options.threads);
+    std::vector<Box> boxes;
+    std::vector<TriangleForGLSL *> ordered = triangles;
+    AABB *aabb = build_aabb(boxes, ordered, options.builder,
+                            options.build_params, pool);
+    int root_id = aabb->root_id;
+    delete aabb;
+    std::vector<QuantizedBox> quantized = quantize_bvh(boxes, root_id);
+    std::vector<Ray> rays = benchmark_rays(triangles, BENCHMARK_RAY_COUNT);
+
+    std::cout << "builder " << builder_name(options.builder) << ", "
+              << sizeof(Box) << " bytes per full node, "
+              << sizeof(QuantizedBox) << " per quantized node" << std::endl;
+    print_traversal_header(rays.size());
+    std::vector<Hit> reference = report_traversal(
+        "full", boxes.size(), boxes.size() * sizeof(Box), rays, {},
+        [&](const Ray &ray, TraversalStats &stats) {
+            return trace_bvh(boxes, root_id, ordered, ray, stats);
+        });
+    report_traversal("quantized", quantized.size(),
+                     quantized.size() * sizeof(QuantizedBox), rays, reference,
+                     [&](const Ray &ray, TraversalStats &stats) {
+                         return trace_quantized_bvh(quantized, ordered, ray,
+                                                    stats);
+                     });
+}
+
+// Traversal work of the stack-based walk against the skip and parent link
+// walks over the same tree
+void benchmark_stackless(const std::vector<TriangleForGLSL *> &triangles,
+                         const Options &options) {
+    ThreadPool pool(options.threads);
+    std::vector<Box> boxes;
+    std::vector<TriangleForGLSL *> ordered = triangles;
+    AABB *aabb = build_aabb(boxes, ordered, options.builder,
+                            options.build_params, pool);
+    int root_id = aabb->root_id;
+    delete aabb;
+    std::vector<StacklessLink> links = stackless_links(boxes, root_id);
+    std::vector<Ray> rays = benchmark_rays(triangles, BENCHMARK_RAY_COUNT);
+    size_t bytes = boxes.size() * sizeof(Box);
+    size_t linked_bytes = bytes + links.size() * sizeof(StacklessLink);
+
+    std::cout << "builder " << builder_name(options.builder) << std::endl;
+    print_traversal_header(rays.size());
+    std::vector<Hit> reference = report_traversal(
+        "stack", boxes.size(), bytes, rays, {},
+        [&](const Ray &ray, TraversalStats &stats) {
+            return trace_bvh(boxes, root_id, ordered, ray, stats);
+        });
+    report_traversal("skip", boxes.size(), linked_bytes, rays, reference,
+                     [&](const Ray &ray, TraversalStats &stats) {
+                         return trace_bvh_skip(boxes, root_id, links, ordered,
+                                               ray, stats);
+                     });
+    report_traversal("parent", boxes.size(), linked_bytes, rays, reference,
+                     [&](const Ray &ray, TraversalStats &stats) {
+                         return trace_bvh_parent(boxes, root_id, links,
+                                                 ordered, ray, stats);
+                     });
+}
+
+// Traversal work of a SAH tree against the tree built for the views of
+// `views`, over the sample rays and over twice as dense rays of the views
+void benchmark_views(const std::vector<TriangleForGLSL *> &triangles,
+                     const Options &options) {
+    std::vector<CameraView> views = load_views(options.views_path);
+    if (views.empty()) {
+        std::cerr << "bench=views needs views=<file> with at least one view"
+                  << std::endl;
+        return;
+    }
+    ThreadPool pool(options.threads);
+    std::vector<Ray> sample = sample_view_rays(views);
+    std::vector<Box> sah_boxes;
+    std::vector<TriangleForGLSL *> sah_triangles = triangles;
+    auto start = std::chrono::steady_clock::now();
+    AABB *aabb = triangles_to_aabb_sah(sah_boxes, sah_triangles,
+                                       options.build_params);
+    double sah_ms = milliseconds_since(start);
+    int sah_root = aabb->root_id;
+    delete aabb;
+    std::vector<Box> view_boxes;
+    std::vector<TriangleForGLSL *> view_triangles = triangles;
+    start = std::chrono::steady_clock::now();
+    aabb = triangles_to_aabb_views(view_boxes, view_triangles, sample,
+                                   options.build_params, pool);
+    double view_ms = milliseconds_since(start);
+    int view_root = aabb->root_id;
+    delete aabb;
+
+    std::cout << views.size() << " views, sah built in " << sah_ms
+              << "ms, views in " << view_ms << "ms" << std::endl;
+    int resolution = std::sqrt(sample.size() / views.size());
+    for (int scale = 1; scale <= 2; ++scale) {
+        std::vector<Ray> rays =
+            scale == 1 ? sample : view_rays(views, resolution * scale);
+        std::cout << (scale == 1 ? "Sample rays, " : "Denser rays, ");
+        print_traversal_header(rays.size());
+        std::vector<Hit> reference = report_traversal(
+            "sah", sah_boxes.size(), sah_boxes.size() * sizeof(Box), rays,
+            {}, [&](const Ray &ray, TraversalStats &stats) {
+                return trace_bvh(sah_boxes, sah_root, sah_triangles, ray,
+                                 stats);
+            });
+        report_traversal(
+            "views", view_boxes.size(), view_boxes.size() * sizeof(Box), rays,
+            reference, [&](const Ray &ray, TraversalStats &stats) {
+                return trace_bvh(view_boxes, view_root, view_triangles, ray,
+                                 stats);
+            });
+    }
+}
+
+// Node-array cache lines each ray touches, and trace time, for every layout
+void benchmark_layout(const std::vector<TriangleForGLSL *> &triangles,
+                      const Options &options) {
+    ThreadPool pool(options.threads);
+    std::vector<Box> boxes;
+    std::vector<TriangleForGLSL *> ordered = triangles;
+    AABB *aabb = build_aabb(boxes, ordered, options.builder,
+                            options.build_params, pool);
+    int root_id = aabb->root_id;
+    delete aabb;
+    std::vector<Ray> rays = benchmark_rays(triangles, BENCHMARK_RAY_COUNT);
+
+    std::cout << "builder " << builder_name(options.builder) << ", "
+              << rays.size() << " rays, averages per ray" << std::endl
+              << "layout  cache lines     steps  trace ms  mismatches"
+              << std::endl;
+    std::vector<Hit> reference;
+    for (int layout = 0; layout < LAYOUT_COUNT; ++layout) {
+        std::vector<Box> relaid = boxes;
+        int relaid_root = relayout_bvh(relaid, root_id, layout);
+        TraversalStats stats;
+        std::vector<Hit> hits(rays.size());
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rays.size(); ++i) {
+            hits[i] = trace_bvh(relaid, relaid_root, ordered, rays[i], stats);
+        }
+        double ms = milliseconds_since(start);
+        // Counted in a second pass, which would distort the timing
+        stats = TraversalStats();
+        for (const auto &ray : rays) {
+            trace_bvh(relaid, relaid_root, ordered, ray, stats, true);
+        }
+        if (reference.empty()) {
+            reference = hits;
+        }
+        int mismatches = 0;
+        for (size_t i = 0; i < rays.size(); ++i) {
+            mismatches += hits[i].t != reference[i].t;
+        }
+        std::cout << std::left << std::setw(6) << layout_name(layout)
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(13)
+                  << stats.cache_lines / static_cast<double>(rays.size())
+                  << std::setw(10)
+                  << stats.nodes / static_cast<double>(rays.size())
+                  << std::setw(10) << ms << std::setw(12) << mismatches
+                  << std::endl;
+    }
+}
+
+// Triangle data lines each ray reads from the one triangle buffer against
+// the split streams and the welded vertices, over the same tree
+void benchmark_triangles(const std::vector<TriangleForGLSL *> &triangles,
+                         const std::vector<TriangleVertexIds> &vertex_ids,
+                         const std::vector<MaterialForGLSL> &materials,
+                         const Options &options) {
+    ThreadPool pool(options.threads);
+    std::vector<Box> boxes;
+    std::vector<TriangleForGLSL *> ordered = triangles;
+    AABB *aabb = build_aabb(boxes, ordered, options.builder,
+                            options.build_params, pool);
+    int root_id = aabb->root_id;
+    delete aabb;
+    std::vector<TriangleForGLSL> full(ordered.size());
+    for (size_t i = 0; i < ordered.size(); ++i) {
+        full[i] = *ordered[i];
+    }
+    std::vector<TriangleGeometry> geometry;
+    std::vector<TriangleAttributes> attributes;
+    split_triangles(ordered, materials, geometry, attributes);
+    std::vector<TriangleEdges> edges;
+    precompute_triangles(ordered, materials, edges, attributes);
+    // The vertex ids follow the triangles into leaf order
+    std::unordered_map<const TriangleForGLSL *, TriangleVertexIds> ids_of;
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        ids_of[triangles[i]] = vertex_ids[i];
+    }
+    std::vector<TriangleVertexIds> ordered_ids(ordered.size());
+    for (size_t i = 0; i < ordered.size(); ++i) {
+        ordered_ids[i] = ids_of[ordered[i]];
+    }
+    std::vector<PaddedVec3ForGLSL> vertices;
+    std::vector<TriangleIndices> indices;
+    index_triangles(ordered, ordered_ids, materials, vertices, indices,
+                    attributes);
+    std::vector<Ray> rays = benchmark_rays(triangles, BENCHMARK_RAY_COUNT);
+
+    size_t attribute_bytes = attributes.size() * sizeof(TriangleAttributes) +
+                             materials.size() * sizeof(MaterialForGLSL);
+    std::cout << "builder " << builder_name(options.builder) << ", "
+              << vertices.size() << " welded vertices, " << materials.size()
+              << " materials, " << rays.size()
+              << " rays, averages per ray" << std::endl
+              << "triangles  geometry KB  memory KB  cache lines  KB read  "
+                 "mismatches"
+              << std::endl;
+    std::vector<Hit> reference;
+    auto report = [&](const char *name, size_t geometry_bytes,
+                      size_t memory_bytes, const auto &trace) {
+        TraversalStats stats;
+        std::vector<Hit> hits(rays.size());
+        for (size_t i = 0; i < rays.size(); ++i) {
+            hits[i] = trace(rays[i], stats);
+        }
+        if (reference.empty()) {
+            reference = hits;
+        }
+        int mismatches = 0;
+        for (size_t i = 0; i < rays.size(); ++i) {
+            mismatches += hits[i].t != reference[i].t;
+        }
+        double lines = stats.triangle_lines / static_cast<double>(rays.size());
+        std::cout << std::left << std::setw(9) << name << std::right
+                  << std::setw(13) << geometry_bytes / 1024 << std::setw(11)
+                  << memory_bytes / 1024 << std::fixed << std::setprecision(1)
+                  << std::setw(13) << lines << std::setw(9)
+                  << lines * 64 / 1024 << std::setw(12) << mismatches
+                  << std::endl;
+    };
+    // The vertices are the first 48 bytes of a full triangle
+    size_t full_bytes = full.size() * sizeof(TriangleForGLSL);
+    report("full", full.size() * sizeof(TriangleGeometry), full_bytes,
+           [&](const Ray &ray, TraversalStats &stats) {
+               return trace_full_triangles(boxes, root_id, full, ray, stats);
+           });
+    size_t geometry_bytes = geometry.size() * sizeof(TriangleGeometry);
+    report("split", geometry_bytes, geometry_bytes + attribute_bytes,
+           [&](const Ray &ray, TraversalStats &stats) {
+               return trace_split_triangles(boxes, root_id, geometry,
+                                            attributes, ray, stats);
+           });
+    report("edges", geometry_bytes, geometry_bytes + attribute_bytes,
+           [&](const Ray &ray, TraversalStats &stats) {
+               return trace_precomputed_triangles(boxes, root_id, edges,
+                                                  attributes, ray, stats);
+           });
+    size_t indexed_bytes = vertices.size() * sizeof(PaddedVec3ForGLSL) +
+                           indices.size() * sizeof(TriangleIndices);
+    report("indexed", indexed_bytes, indexed_bytes + attribute_bytes,
+           [&](const Ray &ray, TraversalStats &stats) {
+               return trace_indexed_triangles(boxes, root_id, vertices,
+                                              indices, attributes, ray,
+                                              stats);
+           });
+}
+
+const int BENCHMARK_TEST_COUNT = 4000000;
+const int BENCHMARK_TEST_REPEATS = 3;
+
+// Time of a single ray-triangle test from the vertices against the
+// precomputed edges, over the same pairs of a ray and a triangle. The
+// triangles are taken in order, so the prefetcher hides the memory and the
+// tests themselves are timed; every ray is aimed near its triangle.
+void benchmark_intersect(const std::vector<TriangleForGLSL *> &triangles,
+                         const std::vector<MaterialForGLSL> &materials) {
+    if (triangles.empty()) {
+        std::cerr << "bench=intersect needs a model with at least one "
+                     "triangle"
+                  << std::endl;
+        return;
+    }
+    std::vector<TriangleGeometry> geometry;
+    std::vector<TriangleEdges> edges;
+    std::vector<TriangleAttributes> attributes;
+    split_triangles(triangles, materials, geometry, attributes);
+    precompute_triangles(triangles, materials, edges, attributes);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0, 1);
+    std::normal_distribution<float> normal;
+    std::vector<Ray> rays(BENCHMARK_TEST_COUNT);
+    std::vector<int> targets(BENCHMARK_TEST_COUNT);
+    for (int i = 0; i < BENCHMARK_TEST_COUNT; ++i) {
+        targets[i] = i % triangles.size();
+        const TriangleGeometry &triangle = geometry[targets[i]];
+        // Barycentric coordinates a little outside the triangle too
+        float u = unit(random) * 1.2f - 0.1f;
+        float v = unit(random) * (1.1f - u);
+        PaddedVec3ForGLSL direction{normal(random), normal(random),
+                                    normal(random), 0};
+        PaddedVec3ForGLSL origin{
+            triangle.v1.x + u * (triangle.v2.x - triangle.v1.x) +
+                v * (triangle.v3.x - triangle.v1.x) - direction.x,
+            triangle.v1.y + u * (triangle.v2.y - triangle.v1.y) +
+                v * (triangle.v3.y - triangle.v1.y) - direction.y,
+            triangle.v1.z + u * (triangle.v2.z - triangle.v1.z) +
+                v * (triangle.v3.z - triangle.v1.z) - direction.z,
+            0};
+        rays[i] = make_ray(origin, direction);
+    }
+
+    std::cout << BENCHMARK_TEST_COUNT << " tests, best of "
+              << BENCHMARK_TEST_REPEATS << std::endl
+              << "test      ns per test      hits  mismatches" << std::endl;
+    std::vector<float> reference;
+    auto report = [&](const char *name, const auto &test) {
+        std::vector<float> ts(rays.size());
+        double best = 0;
+        for (int repeat = 0; repeat < BENCHMARK_TEST_REPEATS; ++repeat) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < rays.size(); ++i) {
+                ts[i] = test(rays[i], targets[i]);
+            }
+            double ms = milliseconds_since(start);
+            best = repeat == 0 ? ms : std::min(best, ms);
+        }
+        if (reference.empty()) {
+            reference = ts;
+        }
+        int hits = 0;
+        int mismatches = 0;
+        for (size_t i = 0; i < ts.size(); ++i) {
+            hits += std::isfinite(ts[i]);
+            mismatches += ts[i] != reference[i];
+        }
+        std::cout << std::left << std::setw(9) << name << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(12)
+                  << best * 1e6 / rays.size() << std::setw(10) << hits
+                  << std::setw(12) << mismatches << std::endl;
+    };
+    report("vertices", [&](const Ray &ray, int i) {
+        const TriangleGeometry &triangle = geometry[i];
+        return intersect_ray_vertices(ray, triangle.v1, triangle.v2,
+                                      triangle.v3);
+    });
+    report("edges", [&](const Ray &ray, int i) {
+        const TriangleEdges &triangle = edges[i];
+        return intersect_ray_edges(ray, triangle.v1, triangle.e1,
+                                   triangle.e2);
+    });
+}
+
+// Times every autotune candidate over the fixed views and saves the fastest
+// to the profile later runs load
+void benchmark_autotune(const std::vector<TriangleForGLSL *> &triangles,
+                        const Options &options) {
+    ThreadPool pool(options.threads);
+    std::vector<Ray> rays = autotune_rays(triangles);
+    std::cout << "builder " << builder_name(options.builder) << ", "
+              << rays.size() << " view rays, " << options.threads
+              << " threads" << std::endl;
+    std::vector<TuneCandidate> candidates =
+        autotune(triangles, options.builder, options.build_params, rays, pool);
+    std::cout << " leaf  traversal cost  width  build ms  SAH cost  trace ms"
+              << std::endl;
+    for (const auto &candidate : candidates) {
+        std::cout << std::setw(5) << candidate.params.leaf_size << std::fixed
+                  << std::setprecision(1) << std::setw(16)
+                  << candidate.params.traversal_cost << std::setw(7)
+                  << candidate.bvh_width << std::setw(10)
+                  << candidate.build_ms << std::setprecision(2)
+                  << std::setw(10) << candidate.sah_cost
+                  << std::setprecision(1) << std::setw(10)
+                  << candidate.trace_ms << std::endl;
+    }
+
+    const TuneCandidate &best = candidates.front();
+    std::cout << "Fastest: leaf=" << best.params.leaf_size
+              << " traversal_cost=" << best.params.traversal_cost
+              << " width=" << best.bvh_width << std::endl;
+    if (options.profile_path.empty() || options.profile_path == "none") {
+        return;
+    }
+    if (save_profile(options.profile_path, best, options.builder)) {
+        std::cout << "Saved to " << options.profile_path << std::endl;
+    } else {
+        std::cerr << "Could not write " << options.profile_path << std::endl;
+    }
+}
+
+// SAH cost of the tree of every builder after every treelet pass, with the
+// time the passes take against the build itself
+void benchmark_treelets(const std::vector<TriangleForGLSL *> &triangles,
+                        const Options &options) {
+    int passes = options.treelet_passes > 0 ? options.treelet_passes : 3;
+    ThreadPool pool(options.threads);
+    std::cout << passes << " passes, SAH cost before and after each"
+              << std::endl
+              << "builder   build ms  passes ms  SAH cost" << std::endl;
+    for (int builder = 0; builder < BUILDER_COUNT; ++builder) {
+        std::vector<Box> boxes;
+        std::vector<TriangleForGLSL *> ordered = triangles;
+        auto start = std::chrono::steady_clock::now();
+        AABB *aabb =
+            build_aabb(boxes, ordered, builder, options.build_params, pool);
+        double build_ms = milliseconds_since(start);
+        start = std::chrono::steady_clock::now();
+        std::vector<float> costs = optimize_treelets(
+            boxes, ordered, *aabb, options.build_params, passes, pool);
+        double passes_ms = milliseconds_since(start);
+        std::cout << std::left << std::setw(8) << builder_name(builder)
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << build_ms << std::setw(11) << passes_ms
+                  << " " << std::setprecision(2);
+        for (float cost : costs) {
+            std::cout << " " << cost;
+        }
+        std::cout << std::endl;
+        delete aabb;
+    }
+}
+
+const int BENCHMARK_BATCH_COUNT = 8;
+
+// Streams the scene into a dynamic BVH in batches, removes every other one
+// and inserts them again, against rebuilding the whole scene
+void benchmark_dynamic(const std::vector<TriangleForGLSL *> &triangles,
+                       const Options &options) {
+    ThreadPool pool(options.threads);
+    std::vector<std::vector<TriangleForGLSL *>> batches(
+        BENCHMARK_BATCH_COUNT);
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        batches[i * BENCHMARK_BATCH_COUNT / triangles.size()].push_back(
+            triangles[i]);
+    }
+    DynamicBVH bvh;
+    std::cout << "builder " << builder_name(options.builder) << ", "
+              << BENCHMARK_BATCH_COUNT << " batches" << std::endl
+              << "step      batch  triangles   time ms     nodes  SAH cost"
+              << std::endl;
+    auto report = [&](const char *step, int batch, int count, double ms) {
+        std::cout << std::left << std::setw(8) << step << std::right
+                  << std::setw(7) << batch << std::setw(11) << count
+                  << std::fixed
+                  << std::setprecision(1) << std::setw(10) << ms
+                  << std::setw(10) << bvh.boxes.size() - bvh.free_boxes.size()
+                  << std::setw(10) << std::setprecision(2)
+                  << (bvh.root_id == -1
+                          ? 0
+                          : sah_cost(bvh.boxes, bvh.root_id,
+                                     options.build_params))
+                  << std::endl;
+    };
+    for (const auto &batch : batches) {
+        auto start = std::chrono::steady_clock::now();
+        int batch_id = insert_batch(bvh, batch, options.builder,
+                                    options.build_params, pool);
+        report("insert", batch_id, batch.size(), milliseconds_since(start));
+    }
+    for (int batch = 1; batch < BENCHMARK_BATCH_COUNT; batch += 2) {
+        int count = bvh.batches[batch].triangle_count;
+        auto start = std::chrono::steady_clock::now();
+        remove_batch(bvh, batch);
+        report("remove", batch, count, milliseconds_since(start));
+    }
+    for (int batch = 1; batch < BENCHMARK_BATCH_COUNT; batch += 2) {
+        auto start = std::chrono::steady_clock::now();
+        int batch_id = insert_batch(bvh, batches[batch], options.builder,
+                                    options.build_params, pool);
+        report("insert", batch_id, batches[batch].size(),
+               milliseconds_since(start));
+    }
+
+    std::vector<Box> boxes;
+    std::vector<TriangleForGLSL *> ordered = triangles;
+    auto start = std::chrono::steady_clock::now();
+    AABB *aabb = build_aabb(boxes, ordered, options.builder,
+                            options.build_params, pool);
+    double ms = milliseconds_since(start);
+    std::cout << "rebuild of the whole scene: " << std::fixed
+              << std::setprecision(1) << ms << " ms, " << boxes.size()
+              << " nodes, SAH cost " << std::setprecision(2)
+              << sah_cost(boxes, aabb->root_id, options.build_params)
+              << std::endl;
+    delete aabb;
+}
+
+bool run_benchmark(const std::vector<TriangleForGLSL *> &triangles,
+                   const std::vector<TriangleVertexIds> &vertex_ids,
+                   const std::vector<MaterialForGLSL> &materials,
+                   const Options &options) {
+    std::cout << "Benchmark " << options.bench << " over " << triangles.size()
+              << " triangles" << std::endl;
+    if (options.bench == "threads") {
+        benchmark_threads(triangles, options);
+    } else if (options.bench == "arena") {
+        benchmark_arena(triangles, options);
+    } else if (options.bench == "builders") {
+        benchmark_builders(triangles, options);
+    } else if (options.bench == "refit") {
+        benchmark_refit(triangles, options);
+    } else if (options.bench == "wide") {
+        benchmark_wide(triangles, options);
+    } else if (options.bench == "quantized") {
+        benchmark_quantized(triangles, options);
+    } else if (options.bench == "stackless") {
+        benchmark_stackless(triangles, options);
+    } else if (options.bench == "views") {
+        benchmark_views(triangles, options);
+    } else if (options.bench == "triangles") {
+        benchmark_triangles(triangles, vertex_ids, materials, options);
+    } else if (options.bench == "intersect") {
+        benchmark_intersect(triangles, materials);
+    } else if (options.bench == "layout") {
+        benchmark_layout(triangles, options);
+    } else if (options.bench == "autotune") {
+        benchmark_autotune(triangles, options);
+    } else if (options.bench == "treelets") {
+        benchmark_treelets(triangles, options);
+    } else if (options.bench == "dynamic") {
+        benchmark_dynamic(triangles, options);
+    } else {
+        std::cerr << "Unknown benchmark: " << options.bench << std::endl;
+        return false;
+    }
+    return true;
+}
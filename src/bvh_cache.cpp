@@ -0,0 +1,247 @@
+#include "./bvh_cache.hpp"
+#include "./aabb.hpp"
+#include "./thread_pool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+const int BVH_CACHE_HASH_CHUNK = 65536;
+const char BVH_CACHE_MAGIC[4] = {'B', 'V', 'H', 'C'};
+
+// Hash of the builder sources, generated by CMake. Builds without it fall
+// back to when this file was compiled.
+#ifdef HAVE_SOURCE_STAMP
+#include "source_stamp.hpp"
+#endif
+#ifdef SOURCE_STAMP
+const char *BVH_CACHE_SOURCE_STAMP = SOURCE_STAMP;
+#else
+const char *BVH_CACHE_SOURCE_STAMP = __DATE__ " " __TIME__;
+#endif
+
+// Start of every cache file, followed by the boxes and then one int32 per
+// triangle reference: its index in load order
+struct BVHCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t triangle_count;
+    uint32_t box_count;
+    uint32_t reference_count;
+    int32_t root_id;
+};
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t bvh_cache_key(const std::vector<TriangleForGLSL *> &triangles,
+                       int builder, const BuildParams &params,
+                       int treelet_passes, ThreadPool &pool) {
+    int count = triangles.size();
+    int chunk_count = (count + BVH_CACHE_HASH_CHUNK - 1) / BVH_CACHE_HASH_CHUNK;
+    std::vector<uint64_t> chunks(chunk_count);
+    pool.parallel_for(0, chunk_count, 1, [&](int chunk) {
+        uint64_t hash = FNV_OFFSET;
+        int end = std::min(count, (chunk + 1) * BVH_CACHE_HASH_CHUNK);
+        for (int i = chunk * BVH_CACHE_HASH_CHUNK; i < end; ++i) {
+            for (const PaddedVec3ForGLSL *vertex :
+                 {&triangles[i]->v1, &triangles[i]->v2, &triangles[i]->v3}) {
+                // Not the padding, which is not always initialised
+                hash = fnv1a(hash, &vertex->x, 3 * sizeof(float));
+            }
+        }
+        chunks[chunk] = hash;
+    });
+
+    uint64_t hash = FNV_OFFSET;
+    hash = fnv1a(hash, &BVH_CACHE_VERSION, sizeof(BVH_CACHE_VERSION));
+    hash = fnv1a(hash, BVH_CACHE_SOURCE_STAMP,
+                 std::strlen(BVH_CACHE_SOURCE_STAMP));
+    uint32_t box_size = sizeof(Box);
+    hash = fnv1a(hash, &box_size, sizeof(box_size));
+    hash = fnv1a(hash, &count, sizeof(count));
+    hash = fnv1a(hash, chunks.data(), chunks.size() * sizeof(uint64_t));
+    hash = fnv1a(hash, &builder, sizeof(builder));
+    hash = fnv1a(hash, &treelet_passes, sizeof(treelet_passes));
+    hash = fnv1a(hash, &params.leaf_size, sizeof(params.leaf_size));
+    hash = fnv1a(hash, &params.traversal_cost, sizeof(params.traversal_cost));
+    hash = fnv1a(hash, &params.intersection_cost,
+                 sizeof(params.intersection_cost));
+    hash = fnv1a(hash, &params.bin_count, sizeof(params.bin_count));
+    hash = fnv1a(hash, &params.split_alpha, sizeof(params.split_alpha));
+    hash = fnv1a(hash, &params.duplication_budget,
+                 sizeof(params.duplication_budget));
+    hash = fnv1a(hash, &params.morton_bits, sizeof(params.morton_bits));
+    hash = fnv1a(hash, &params.ploc_radius, sizeof(params.ploc_radius));
+    hash = fnv1a(hash, &params.clip_budget, sizeof(params.clip_budget));
+    hash = fnv1a(hash, &params.clip_ratio, sizeof(params.clip_ratio));
+    return hash;
+}
+
+std::string default_cache_dir() {
+    const char *cache = std::getenv("XDG_CACHE_HOME");
+    if (cache != nullptr && *cache != '\0') {
+        return std::string(cache) + "/myownraytracer";
+    }
+    const char *home = std::getenv("HOME");
+    if (home != nullptr && *home != '\0') {
+        return std::string(home) + "/.cache/myownraytracer";
+    }
+    return "";
+}
+
+std::string bvh_cache_path(const std::string &dir, uint64_t key) {
+    std::ostringstream name;
+    name << dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+         << key << ".bvh";
+    return name.str();
+}
+
+// Child ids and triangle ranges of every box stay inside the arrays, and
+// every box is reached exactly once from the root, so no cycles or shared
+// children
+bool valid_boxes(const std::vector<Box> &boxes, int root_id,
+                 int reference_count) {
+    int box_count = boxes.size();
+    std::vector<bool> reached(box_count, false);
+    std::vector<int> stack = {root_id};
+    int reached_count = 0;
+    while (!stack.empty()) {
+        int box_id = stack.back();
+        stack.pop_back();
+        if (reached[box_id]) {
+            return false;
+        }
+        reached[box_id] = true;
+        ++reached_count;
+        const Box &box = boxes[box_id];
+        if (box.left_id == -1) {
+            if (box.start < 0 || box.start > box.end ||
+                box.end > reference_count) {
+                return false;
+            }
+        } else if (box.left_id < 0 || box.left_id >= box_count ||
+                   box.right_id < 0 || box.right_id >= box_count) {
+            return false;
+        } else {
+            stack.push_back(box.left_id);
+            stack.push_back(box.right_id);
+        }
+    }
+    return reached_count == box_count;
+}
+
+bool load_cached_bvh(const std::string &dir, uint64_t key,
+                     const std::vector<TriangleForGLSL *> &loaded,
+                     std::vector<Box> &boxes,
+                     std::vector<TriangleForGLSL *> &triangles, int &root_id) {
+    std::ifstream file(bvh_cache_path(dir, key),
+                       std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    size_t size = file.tellg();
+    if (size < sizeof(BVHCacheHeader)) {
+        return false;
+    }
+    // One read of the whole file
+    std::vector<char> data(size);
+    file.seekg(0);
+    if (!file.read(data.data(), size)) {
+        return false;
+    }
+    BVHCacheHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, BVH_CACHE_MAGIC, 4) != 0 ||
+        header.version != BVH_CACHE_VERSION || header.key != key ||
+        header.triangle_count != loaded.size() || header.box_count == 0 ||
+        size != sizeof(header) + header.box_count * sizeof(Box) +
+                    header.reference_count * sizeof(int32_t) ||
+        header.root_id < 0 ||
+        header.root_id >= static_cast<int32_t>(header.box_count)) {
+        return false;
+    }
+
+    const char *box_data = data.data() + sizeof(header);
+    std::vector<Box> cached(
+        reinterpret_cast<const Box *>(box_data),
+        reinterpret_cast<const Box *>(box_data) + header.box_count);
+    if (!valid_boxes(cached, header.root_id, header.reference_count)) {
+        return false;
+    }
+    std::vector<int32_t> order(header.reference_count);
+    std::memcpy(order.data(), box_data + header.box_count * sizeof(Box),
+                order.size() * sizeof(int32_t));
+    std::vector<TriangleForGLSL *> ordered(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (order[i] < 0 ||
+            order[i] >= static_cast<int32_t>(header.triangle_count)) {
+            return false;
+        }
+        ordered[i] = loaded[order[i]];
+    }
+    boxes.swap(cached);
+    triangles.swap(ordered);
+    root_id = header.root_id;
+    return true;
+}
+
+bool save_cached_bvh(const std::string &dir, uint64_t key,
+                     const std::vector<TriangleForGLSL *> &loaded,
+                     const std::vector<Box> &boxes,
+                     const std::vector<TriangleForGLSL *> &triangles,
+                     int root_id) {
+    std::unordered_map<const TriangleForGLSL *, int32_t> indices;
+    indices.reserve(loaded.size());
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        indices[loaded[i]] = i;
+    }
+    std::vector<int32_t> order(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        order[i] = indices.at(triangles[i]);
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    std::string path = bvh_cache_path(dir, key);
+    // Written aside and renamed, so a reader never sees half a file
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        BVHCacheHeader header{
+            {BVH_CACHE_MAGIC[0], BVH_CACHE_MAGIC[1], BVH_CACHE_MAGIC[2],
+             BVH_CACHE_MAGIC[3]},
+            BVH_CACHE_VERSION,
+            key,
+            static_cast<uint32_t>(loaded.size()),
+            static_cast<uint32_t>(boxes.size()),
+            static_cast<uint32_t>(order.size()),
+            root_id};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(boxes.data()),
+                   boxes.size() * sizeof(Box));
+        file.write(reinterpret_cast<const char *>(order.data()),
+                   order.size() * sizeof(int32_t));
+        if (!file) {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
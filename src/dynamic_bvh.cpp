@@ -0,0 +1,269 @@
+#include "./dynamic_bvh.hpp"
+#include "./aabb.hpp"
+#include "./refit.hpp"
+#include "./thread_pool.hpp"
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+int allocate_box(DynamicBVH &bvh, const Box &box) {
+    int box_id;
+    if (bvh.free_boxes.empty()) {
+        box_id = bvh.boxes.size();
+        bvh.boxes.push_back(box);
+        bvh.parents.push_back(-1);
+    } else {
+        box_id = bvh.free_boxes.back();
+        bvh.free_boxes.pop_back();
+        bvh.boxes[box_id] = box;
+    }
+    bvh.dirty_boxes.push_back(box_id);
+    return box_id;
+}
+
+// First hole the batch fits in, else the end of the array
+int allocate_triangles(DynamicBVH &bvh, int count) {
+    for (auto &hole : bvh.free_triangles) {
+        if (hole.end - hole.begin >= count) {
+            int start = hole.begin;
+            hole.begin += count;
+            return start;
+        }
+    }
+    int start = bvh.triangles.size();
+    bvh.triangles.resize(start + count);
+    return start;
+}
+
+void replace_child(DynamicBVH &bvh, int parent_id, int old_child,
+                   int new_child) {
+    bvh.parents[new_child] = parent_id;
+    if (parent_id == -1) {
+        bvh.root_id = new_child;
+        return;
+    }
+    Box &parent = bvh.boxes[parent_id];
+    if (parent.left_id == old_child) {
+        parent.left_id = new_child;
+    } else {
+        parent.right_id = new_child;
+    }
+    bvh.dirty_boxes.push_back(parent_id);
+}
+
+// Swaps a child of `box_id` with a grandchild under the other child when
+// that shrinks the other child (Kopta et al., "Fast, Effective BVH Updates
+// for Animated Scenes"). The box itself keeps its bounds.
+void rotate(DynamicBVH &bvh, int box_id) {
+    const Box &box = bvh.boxes[box_id];
+    int best_child = -1;
+    int best_grandchild = -1;
+    float best_gain = 0;
+    for (int side = 0; side < 2; ++side) {
+        int child = side == 0 ? box.left_id : box.right_id;
+        int other = side == 0 ? box.right_id : box.left_id;
+        const Box &other_box = bvh.boxes[other];
+        if (other_box.left_id == -1) {
+            continue;
+        }
+        float area = surface_area(box_bounds(other_box));
+        int grandchildren[2] = {other_box.left_id, other_box.right_id};
+        for (int i = 0; i < 2; ++i) {
+            // `child` takes the place of grandchildren[i]
+            float rotated = surface_area(
+                merge_bounds(box_bounds(bvh.boxes[child]),
+                             box_bounds(bvh.boxes[grandchildren[1 - i]])));
+            if (area - rotated > best_gain) {
+                best_gain = area - rotated;
+                best_child = child;
+                best_grandchild = grandchildren[i];
+            }
+        }
+    }
+    if (best_child == -1) {
+        return;
+    }
+    int other = bvh.parents[best_grandchild];
+    replace_child(bvh, box_id, best_child, best_grandchild);
+    replace_child(bvh, other, best_grandchild, best_child);
+    Box &other_box = bvh.boxes[other];
+    Bounds bounds = merge_bounds(box_bounds(bvh.boxes[other_box.left_id]),
+                                 box_bounds(bvh.boxes[other_box.right_id]));
+    other_box.min = bounds.min;
+    other_box.max = bounds.max;
+}
+
+// Refits and rotates every box from `box_id` up to the root
+void update_ancestors(DynamicBVH &bvh, int box_id) {
+    while (box_id != -1) {
+        Box &box = bvh.boxes[box_id];
+        Bounds bounds = merge_bounds(box_bounds(bvh.boxes[box.left_id]),
+                                     box_bounds(bvh.boxes[box.right_id]));
+        box.min = bounds.min;
+        box.max = bounds.max;
+        rotate(bvh, box_id);
+        bvh.dirty_boxes.push_back(box_id);
+        box_id = bvh.parents[box_id];
+    }
+}
+
+// Sibling that adds the least surface area to the tree, found best-first
+// with the bound of Bittner et al., "Fast Insertion-Based Optimization of
+// Bounding Volume Hierarchies"
+int find_sibling(const DynamicBVH &bvh, const Bounds &bounds) {
+    float area = surface_area(bounds);
+    int best = bvh.root_id;
+    float best_cost = surface_area(
+        merge_bounds(box_bounds(bvh.boxes[bvh.root_id]), bounds));
+    // Area the ancestors grow by, smallest first
+    using Entry = std::pair<float, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>
+        queue;
+    queue.push({0.0f, bvh.root_id});
+    while (!queue.empty()) {
+        auto [inherited, box_id] = queue.top();
+        queue.pop();
+        if (inherited + area >= best_cost) {
+            break;
+        }
+        const Box &box = bvh.boxes[box_id];
+        float merged = surface_area(merge_bounds(box_bounds(box), bounds));
+        if (inherited + merged < best_cost) {
+            best = box_id;
+            best_cost = inherited + merged;
+        }
+        float child_inherited =
+            inherited + merged - surface_area(box_bounds(box));
+        if (box.left_id != -1 && child_inherited + area < best_cost) {
+            queue.push({child_inherited, box.left_id});
+            queue.push({child_inherited, box.right_id});
+        }
+    }
+    return best;
+}
+
+void insert_leaf(DynamicBVH &bvh, int leaf_id) {
+    if (bvh.root_id == -1) {
+        bvh.root_id = leaf_id;
+        bvh.parents[leaf_id] = -1;
+        return;
+    }
+    Bounds bounds = box_bounds(bvh.boxes[leaf_id]);
+    int sibling = find_sibling(bvh, bounds);
+    int old_parent = bvh.parents[sibling];
+    Bounds merged = merge_bounds(box_bounds(bvh.boxes[sibling]), bounds);
+    int parent = allocate_box(
+        bvh, Box(merged.min, merged.max, sibling, leaf_id, 0, 0));
+    replace_child(bvh, old_parent, sibling, parent);
+    bvh.parents[sibling] = parent;
+    bvh.parents[leaf_id] = parent;
+    update_ancestors(bvh, old_parent);
+}
+
+void remove_leaf(DynamicBVH &bvh, int leaf_id) {
+    bvh.free_boxes.push_back(leaf_id);
+    int parent = bvh.parents[leaf_id];
+    if (parent == -1) {
+        bvh.root_id = -1;
+        return;
+    }
+    const Box &parent_box = bvh.boxes[parent];
+    int sibling = parent_box.left_id == leaf_id ? parent_box.right_id
+                                                : parent_box.left_id;
+    int grandparent = bvh.parents[parent];
+    replace_child(bvh, grandparent, parent, sibling);
+    bvh.free_boxes.push_back(parent);
+    update_ancestors(bvh, grandparent);
+}
+
+// Copies the tree of a first batch as it is, leaves already offset
+void adopt_tree(DynamicBVH &bvh, const std::vector<Box> &boxes, int root_id,
+                DynamicBatch &batch) {
+    struct Entry {
+        int box_id;
+        int parent;
+        bool left;
+    };
+    std::vector<Entry> stack = {{root_id, -1, false}};
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        Box box = boxes[entry.box_id];
+        if (box.left_id != -1) {
+            box.start = 0;
+            box.end = 0;
+        }
+        int box_id = allocate_box(bvh, box);
+        bvh.parents[box_id] = entry.parent;
+        if (entry.parent == -1) {
+            bvh.root_id = box_id;
+        } else if (entry.left) {
+            bvh.boxes[entry.parent].left_id = box_id;
+        } else {
+            bvh.boxes[entry.parent].right_id = box_id;
+        }
+        if (box.left_id == -1) {
+            batch.leaves.push_back(box_id);
+        } else {
+            stack.push_back({box.right_id, box_id, false});
+            stack.push_back({box.left_id, box_id, true});
+        }
+    }
+}
+
+int insert_batch(DynamicBVH &bvh, std::vector<TriangleForGLSL *> triangles,
+                 int builder, const BuildParams &params, ThreadPool &pool) {
+    std::vector<Box> boxes;
+    DynamicBatch batch{{}, 0, 0};
+    if (!triangles.empty()) {
+        AABB *aabb = build_aabb(boxes, triangles, builder, params, pool);
+        int root_id = aabb->root_id;
+        delete aabb;
+        batch.triangle_count = triangles.size();
+        batch.triangle_start = allocate_triangles(bvh, triangles.size());
+        for (size_t i = 0; i < triangles.size(); ++i) {
+            bvh.triangles[batch.triangle_start + i] = *triangles[i];
+        }
+        bvh.dirty_triangles.push_back(
+            DirtyRange{batch.triangle_start,
+                       batch.triangle_start + batch.triangle_count});
+        for (auto &box : boxes) {
+            if (box.left_id == -1) {
+                box.start += batch.triangle_start;
+                box.end += batch.triangle_start;
+            }
+        }
+
+        if (bvh.root_id == -1) {
+            adopt_tree(bvh, boxes, root_id, batch);
+        } else {
+            for (const auto &box : boxes) {
+                if (box.left_id == -1) {
+                    int leaf_id = allocate_box(bvh, box);
+                    batch.leaves.push_back(leaf_id);
+                    insert_leaf(bvh, leaf_id);
+                }
+            }
+        }
+    }
+    bvh.batches.push_back(batch);
+    return bvh.batches.size() - 1;
+}
+
+bool remove_batch(DynamicBVH &bvh, int batch_id) {
+    if (batch_id < 0 || batch_id >= static_cast<int>(bvh.batches.size()) ||
+        bvh.batches[batch_id].triangle_count == 0) {
+        return false;
+    }
+    DynamicBatch &batch = bvh.batches[batch_id];
+    for (int leaf_id : batch.leaves) {
+        remove_leaf(bvh, leaf_id);
+    }
+    bvh.free_triangles.push_back(
+        DirtyRange{batch.triangle_start,
+                   batch.triangle_start + batch.triangle_count});
+    batch.leaves.clear();
+    batch.triangle_count = 0;
+    return true;
+}
@@ -0,0 +1,121 @@
+#include "./early_split.hpp"
+#include "./aabb.hpp"
+#include "./sbvh.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+struct ClipPiece {
+    float area;
+    int triangle;
+    Bounds bounds;
+};
+
+bool operator<(const ClipPiece &a, const ClipPiece &b) {
+    return a.area < b.area;
+}
+
+ClippedReferences clip_large_triangles(
+    const std::vector<TriangleForGLSL *> &triangles,
+    const BuildParams &params) {
+    ClippedReferences clipped;
+    int count = triangles.size();
+    int budget = params.clip_budget * count;
+    if (budget <= 0) {
+        clipped.references = triangles;
+        return clipped;
+    }
+    std::vector<float> areas(count);
+    for (int i = 0; i < count; ++i) {
+        areas[i] = surface_area(triangle_bounds(*triangles[i]));
+    }
+    std::vector<float> sorted = areas;
+    std::nth_element(sorted.begin(), sorted.begin() + count / 2,
+                     sorted.end());
+    float threshold = params.clip_ratio * sorted[count / 2];
+
+    std::priority_queue<ClipPiece> queue;
+    for (int i = 0; i < count; ++i) {
+        if (areas[i] > threshold) {
+            queue.push(ClipPiece{areas[i], i, triangle_bounds(*triangles[i])});
+        }
+    }
+    std::vector<ClipPiece> pieces;
+    std::vector<bool> split(count, false);
+    int extra = 0;
+    while (!queue.empty() && extra < budget) {
+        ClipPiece piece = queue.top();
+        queue.pop();
+        PaddedVec3ForGLSL size{piece.bounds.max.x - piece.bounds.min.x,
+                               piece.bounds.max.y - piece.bounds.min.y,
+                               piece.bounds.max.z - piece.bounds.min.z, 0};
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2)
+                                   : (size.y > size.z ? 1 : 2);
+        float low = get_coord(axis, piece.bounds.min);
+        float high = get_coord(axis, piece.bounds.max);
+        float middle = (low + high) * 0.5f;
+        if (!(middle > low && middle < high)) {
+            pieces.push_back(piece);
+            continue;
+        }
+        split[piece.triangle] = true;
+        const TriangleForGLSL &triangle = *triangles[piece.triangle];
+        for (Bounds part :
+             {clip_triangle(triangle, axis, low, middle),
+              clip_triangle(triangle, axis, middle, high)}) {
+            part = intersect_bounds(part, piece.bounds);
+            if (part.min.x > part.max.x || part.min.y > part.max.y ||
+                part.min.z > part.max.z) {
+                continue;
+            }
+            float area = surface_area(part);
+            if (area > threshold) {
+                queue.push(ClipPiece{area, piece.triangle, part});
+            } else {
+                pieces.push_back(ClipPiece{area, piece.triangle, part});
+            }
+            extra++;
+        }
+        // The piece itself is replaced, not added
+        extra--;
+    }
+    for (; !queue.empty(); queue.pop()) {
+        pieces.push_back(queue.top());
+    }
+
+    for (int i = 0; i < count; ++i) {
+        if (!split[i]) {
+            clipped.references.push_back(triangles[i]);
+        }
+    }
+    clipped.proxies.reserve(pieces.size());
+    for (const auto &piece : pieces) {
+        if (!split[piece.triangle]) {
+            continue;
+        }
+        TriangleForGLSL proxy = *triangles[piece.triangle];
+        proxy.min = piece.bounds.min;
+        proxy.max = piece.bounds.max;
+        clipped.proxies.push_back(proxy);
+        clipped.proxy_triangles.push_back(piece.triangle);
+    }
+    for (auto &proxy : clipped.proxies) {
+        clipped.references.push_back(&proxy);
+    }
+    return clipped;
+}
+
+void resolve_clipped_references(
+    std::vector<TriangleForGLSL *> &references,
+    const ClippedReferences &clipped,
+    const std::vector<TriangleForGLSL *> &triangles) {
+    const TriangleForGLSL *first = clipped.proxies.data();
+    const TriangleForGLSL *last = first + clipped.proxies.size();
+    std::less<const TriangleForGLSL *> before;
+    for (auto &reference : references) {
+        if (!before(reference, first) && before(reference, last)) {
+            reference = triangles[clipped.proxy_triangles[reference - first]];
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#include "./layout.hpp"
+#include "./aabb.hpp"
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+const char *LAYOUT_NAMES[LAYOUT_COUNT] = {"post", "dfs", "veb"};
+
+const char *layout_name(int layout) { return LAYOUT_NAMES[layout]; }
+
+int find_layout(const std::string &name) {
+    for (int layout = 0; layout < LAYOUT_COUNT; ++layout) {
+        if (name == LAYOUT_NAMES[layout]) {
+            return layout;
+        }
+    }
+    return -1;
+}
+
+void post_order(const std::vector<Box> &boxes, int root_id,
+                std::vector<int> &order) {
+    // A box is appended when it comes off the stack the second time
+    std::vector<std::pair<int, bool>> stack = {{root_id, false}};
+    while (!stack.empty()) {
+        auto [box_id, children_done] = stack.back();
+        stack.pop_back();
+        const Box &box = boxes[box_id];
+        if (children_done || box.left_id == -1) {
+            order.push_back(box_id);
+            continue;
+        }
+        stack.push_back({box_id, true});
+        stack.push_back({box.right_id, false});
+        stack.push_back({box.left_id, false});
+    }
+}
+
+void depth_first_order(const std::vector<Box> &boxes, int root_id,
+                       std::vector<int> &order) {
+    std::vector<int> stack = {root_id};
+    while (!stack.empty()) {
+        int box_id = stack.back();
+        stack.pop_back();
+        order.push_back(box_id);
+        if (boxes[box_id].left_id != -1) {
+            stack.push_back(boxes[box_id].right_id);
+            stack.push_back(boxes[box_id].left_id);
+        }
+    }
+}
+
+int tree_levels(const std::vector<Box> &boxes, int root_id) {
+    int levels = 0;
+    std::vector<std::pair<int, int>> stack = {{root_id, 1}};
+    while (!stack.empty()) {
+        auto [box_id, level] = stack.back();
+        stack.pop_back();
+        levels = std::max(levels, level);
+        if (boxes[box_id].left_id != -1) {
+            stack.push_back({boxes[box_id].left_id, level + 1});
+            stack.push_back({boxes[box_id].right_id, level + 1});
+        }
+    }
+    return levels;
+}
+
+// Laying out `levels` levels of the subtree at `box_id` lays out the top
+// half of them first, which leaves the roots of the subtrees below in
+// `frontiers[middle]`, then each of those subtrees with the other half,
+// whose own roots below go to `frontiers[frontier]`
+struct VanEmdeBoasTask {
+    int box_id;
+    int levels;
+    int frontier;
+    // -1: lay out the subtree at `box_id`. Else every subtree whose root
+    // is in frontiers[middle], in order.
+    int middle;
+};
+
+void van_emde_boas_order(const std::vector<Box> &boxes, int root_id,
+                         int levels, std::vector<int> &order) {
+    std::vector<std::vector<int>> frontiers(1);
+    std::vector<VanEmdeBoasTask> stack = {{root_id, levels, 0, -1}};
+    while (!stack.empty()) {
+        VanEmdeBoasTask task = stack.back();
+        stack.pop_back();
+        if (task.middle != -1) {
+            const std::vector<int> &roots = frontiers[task.middle];
+            for (auto it = roots.rbegin(); it != roots.rend(); ++it) {
+                stack.push_back({*it, task.levels, task.frontier, -1});
+            }
+            continue;
+        }
+        if (task.levels == 1) {
+            const Box &box = boxes[task.box_id];
+            order.push_back(task.box_id);
+            if (box.left_id != -1) {
+                frontiers[task.frontier].push_back(box.left_id);
+                frontiers[task.frontier].push_back(box.right_id);
+            }
+            continue;
+        }
+        int top_levels = task.levels / 2;
+        int middle = frontiers.size();
+        frontiers.emplace_back();
+        stack.push_back(
+            {-1, task.levels - top_levels, task.frontier, middle});
+        stack.push_back({task.box_id, top_levels, middle, -1});
+    }
+}
+
+int relayout_bvh(std::vector<Box> &boxes, int root_id, int layout) {
+    std::vector<int> order;
+    order.reserve(boxes.size());
+    if (layout == LAYOUT_DFS) {
+        depth_first_order(boxes, root_id, order);
+    } else if (layout == LAYOUT_VEB) {
+        van_emde_boas_order(boxes, root_id, tree_levels(boxes, root_id),
+                            order);
+    } else {
+        post_order(boxes, root_id, order);
+    }
+
+    std::vector<int> new_ids(boxes.size(), -1);
+    for (size_t i = 0; i < order.size(); ++i) {
+        new_ids[order[i]] = i;
+    }
+    std::vector<Box> relaid;
+    relaid.reserve(order.size());
+    for (int box_id : order) {
+        Box box = boxes[box_id];
+        if (box.left_id != -1) {
+            box.left_id = new_ids[box.left_id];
+            box.right_id = new_ids[box.right_id];
+        }
+        relaid.push_back(box);
+    }
+    boxes.swap(relaid);
+    return new_ids[root_id];
+}
@@ -0,0 +1,183 @@
+#include "./lbvh.hpp"
+#include "./aabb.hpp"
+#include "./thread_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Chunks smaller than this are not worth a task of their own
+const int RADIX_SORT_MIN_CHUNK = 16384;
+
+uint64_t spread_bits_10(uint64_t x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+uint64_t spread_bits_21(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | (x << 32)) & 0x1f00000000ffffULL;
+    x = (x | (x << 16)) & 0x1f0000ff0000ffULL;
+    x = (x | (x << 8)) & 0x100f00f00f00f00fULL;
+    x = (x | (x << 4)) & 0x10c30c30c30c30c3ULL;
+    x = (x | (x << 2)) & 0x1249249249249249ULL;
+    return x;
+}
+
+uint64_t morton_code(uint32_t x, uint32_t y, uint32_t z, int bits) {
+    if (bits > 30) {
+        return (spread_bits_21(x) << 2) | (spread_bits_21(y) << 1) |
+               spread_bits_21(z);
+    }
+    return (spread_bits_10(x) << 2) | (spread_bits_10(y) << 1) |
+           spread_bits_10(z);
+}
+
+void radix_sort(std::vector<MortonPrimitive> &primitives, int key_bits,
+                ThreadPool &pool) {
+    int count = primitives.size();
+    int chunk_count = std::max(
+        1, std::min(pool.size() * 4, count / RADIX_SORT_MIN_CHUNK));
+    int chunk_size = (count + chunk_count - 1) / std::max(1, chunk_count);
+    std::vector<MortonPrimitive> sorted(count);
+    std::vector<std::array<int, 256>> offsets(chunk_count);
+
+    for (int shift = 0; shift < key_bits; shift += 8) {
+        pool.parallel_for(0, chunk_count, 1, [&](int chunk) {
+            std::array<int, 256> &histogram = offsets[chunk];
+            histogram.fill(0);
+            int end = std::min(count, (chunk + 1) * chunk_size);
+            for (int i = chunk * chunk_size; i < end; ++i) {
+                histogram[(primitives[i].code >> shift) & 0xff]++;
+            }
+        });
+
+        // Turn the histograms into scatter positions: digit-major, then
+        // chunk order, which keeps every pass stable
+        int position = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            for (int chunk = 0; chunk < chunk_count; ++chunk) {
+                int digit_count = offsets[chunk][digit];
+                offsets[chunk][digit] = position;
+                position += digit_count;
+            }
+        }
+
+        pool.parallel_for(0, chunk_count, 1, [&](int chunk) {
+            std::array<int, 256> &next = offsets[chunk];
+            int end = std::min(count, (chunk + 1) * chunk_size);
+            for (int i = chunk * chunk_size; i < end; ++i) {
+                sorted[next[(primitives[i].code >> shift) & 0xff]++] =
+                    primitives[i];
+            }
+        });
+        primitives.swap(sorted);
+    }
+}
+
+uint32_t quantize(float value, float min, float extent, uint32_t max) {
+    if (extent <= 0) {
+        return 0;
+    }
+    float normalized = (value - min) / extent;
+    return std::min(max, static_cast<uint32_t>(std::max(0.0f, normalized) *
+                                                max));
+}
+
+std::vector<uint64_t> sort_by_morton(std::vector<TriangleForGLSL *> &triangles,
+                                     int bits, ThreadPool &pool) {
+    int count = triangles.size();
+    Bounds centroids = empty_bounds();
+    for (const auto *triangle : triangles) {
+        centroids = merge_bounds(centroids,
+                                 bounds_center(triangle_bounds(*triangle)));
+    }
+    PaddedVec3ForGLSL extent{centroids.max.x - centroids.min.x,
+                             centroids.max.y - centroids.min.y,
+                             centroids.max.z - centroids.min.z, 0};
+    uint32_t max = bits > 30 ? (1u << 21) - 1 : (1u << 10) - 1;
+
+    std::vector<MortonPrimitive> primitives(count);
+    pool.parallel_for(0, count, RADIX_SORT_MIN_CHUNK, [&](int i) {
+        PaddedVec3ForGLSL center =
+            bounds_center(triangle_bounds(*triangles[i]));
+        primitives[i] = MortonPrimitive{
+            morton_code(quantize(center.x, centroids.min.x, extent.x, max),
+                        quantize(center.y, centroids.min.y, extent.y, max),
+                        quantize(center.z, centroids.min.z, extent.z, max),
+                        bits),
+            triangles[i]};
+    });
+    radix_sort(primitives, bits > 30 ? 63 : 30, pool);
+
+    std::vector<uint64_t> codes(count);
+    for (int i = 0; i < count; ++i) {
+        codes[i] = primitives[i].code;
+        triangles[i] = primitives[i].triangle;
+    }
+    return codes;
+}
+
+// Isolates the most significant set bit
+uint64_t highest_bit(uint64_t x) {
+    x |= x >> 1;
+    x |= x >> 2;
+    x |= x >> 4;
+    x |= x >> 8;
+    x |= x >> 16;
+    x |= x >> 32;
+    return x ^ (x >> 1);
+}
+
+Box build_lbvh_node(std::vector<Box> &boxes,
+                    const std::vector<TriangleForGLSL *> &triangles,
+                    const std::vector<uint64_t> &codes, int start, int end,
+                    const BuildParams &params) {
+    int span = end - start;
+    if (span <= params.leaf_size) {
+        Bounds bounds = empty_bounds();
+        for (int i = start; i < end; i++) {
+            bounds = merge_bounds(bounds, triangle_bounds(*triangles[i]));
+        }
+        return Box(bounds.min, bounds.max, -1, -1, start, end);
+    }
+
+    int mid = start + span / 2;
+    if (codes[start] != codes[end - 1]) {
+        // The range shares every bit above the highest differing one, so
+        // codes with that bit clear come first
+        uint64_t bit = highest_bit(codes[start] ^ codes[end - 1]);
+        mid = std::partition_point(codes.begin() + start, codes.begin() + end,
+                                   [bit](uint64_t code) {
+                                       return (code & bit) == 0;
+                                   }) -
+              codes.begin();
+    }
+
+    boxes.emplace_back(
+        build_lbvh_node(boxes, triangles, codes, start, mid, params));
+    int left = boxes.size() - 1;
+    boxes.emplace_back(
+        build_lbvh_node(boxes, triangles, codes, mid, end, params));
+    int right = boxes.size() - 1;
+
+    Bounds bounds =
+        merge_bounds(box_bounds(boxes[left]), box_bounds(boxes[right]));
+    return Box(bounds.min, bounds.max, left, right, start, end);
+}
+
+AABB *triangles_to_aabb_lbvh(std::vector<Box> &boxes,
+                             std::vector<TriangleForGLSL *> &triangles,
+                             const BuildParams &params, ThreadPool &pool) {
+    std::vector<uint64_t> codes =
+        sort_by_morton(triangles, params.morton_bits, pool);
+    boxes.reserve(boxes.size() +
+                  2 * triangles.size() / std::max(1, params.leaf_size) + 1);
+    boxes.emplace_back(build_lbvh_node(boxes, triangles, codes, 0,
+                                       triangles.size(), params));
+    return new AABB{static_cast<int>(boxes.size() - 1)};
+}
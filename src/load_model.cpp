@@ -1,7 +1,9 @@
 #include "./load_model.hpp"
+#include "./material_table.hpp"
 #include "./tiny_gltf.h"
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <string>
 
@@ -126,16 +128,23 @@ void print_triangle(const Triangle &t) {
     std::cout << "]," << std::endl;
 }
 
-void print_json_node(const OurNode &node) {
-    for (const auto &primitive : node.primitives) {
-        std::cout << "    ";
-        print_triangle(primitive);
+void print_json_node(const OurNode &node,
+                     const std::vector<std::vector<Triangle>> &meshes) {
+    if (node.mesh > -1) {
+        for (const auto &primitive : meshes[node.mesh]) {
+            std::cout << "    ";
+            print_triangle(primitive);
+        }
     }
     for (const auto &child : node.children) {
-        print_json_node(child);
+        print_json_node(child, meshes);
     }
 }
 
+void print_json_node(const OurNode &node) {
+    print_json_node(node, node.meshes);
+}
+
 void print_node(const OurNode &node, size_t depth) {
     std::string indent = "";
     for (size_t i = 0; i < depth; i++) {
@@ -149,11 +158,7 @@ void print_node(const OurNode &node, size_t depth) {
               << node.rotation.w << ")" << std::endl;
     std::cout << indent << "  Scale: (" << node.scale.x << ", " << node.scale.y
               << ", " << node.scale.z << ")" << std::endl;
-    std::cout << indent << "  Primitives:" << std::endl;
-    for (const auto &primitive : node.primitives) {
-        std::cout << indent << "    ";
-        print_triangle(primitive);
-    }
+    std::cout << indent << "  Mesh: " << node.mesh << std::endl;
     std::cout << indent << "  Children:" << std::endl;
     for (const auto &child : node.children) {
         print_node(child, depth + 1);
@@ -181,6 +186,209 @@ uint32_t find_texture(const tinygltf::Texture *tex,
     return res;
 }
 
+std::vector<Triangle> load_mesh(const tinygltf::Mesh &mesh,
+                                const tinygltf::Model &model,
+                                uint32_t &vertex_count) {
+    std::vector<Triangle> triangles;
+    vertex_count = 0;
+    for (const auto &primitive : mesh.primitives) {
+        if (primitive.mode != TINYGLTF_MODE_TRIANGLES) {
+            std::cout << "Warning: primitive.mode is not triangles"
+                      << std::endl;
+            continue;
+        }
+        if (primitive.indices == -1) {
+            std::cout << "Warning: primitive.indices == -1; skipping"
+                      << std::endl;
+            continue;
+        }
+        uint32_t index_count = 0;
+        // The vertices of this primitive follow those of the previous ones
+        uint32_t first_vertex = vertex_count;
+
+        std::vector<Vertex> vertex_buffer = std::vector<Vertex>();
+        std::vector<uint32_t> index_buffer = std::vector<uint32_t>();
+
+        const float *buffer_texture_coords;
+        {
+            const tinygltf::Accessor &accessor =
+                model.accessors[primitive.attributes.at("POSITION")];
+
+            const tinygltf::BufferView &buffer_view =
+                model.bufferViews[accessor.bufferView];
+            const tinygltf::Buffer &buffer =
+                model.buffers[buffer_view.buffer];
+            const float *positions = reinterpret_cast<const float *>(
+                &buffer.data[buffer_view.byteOffset + accessor.byteOffset]);
+
+            buffer_texture_coords = nullptr;
+            if (primitive.attributes.find("TEXCOORD_0") !=
+                primitive.attributes.end()) {
+                const tinygltf::Accessor &uv_accessor =
+                    model.accessors[primitive.attributes.find("TEXCOORD_0")
+                                        ->second];
+                const tinygltf::BufferView &uv_view =
+                    model.bufferViews[uv_accessor.bufferView];
+                buffer_texture_coords = reinterpret_cast<const float *>(
+                    &(model.buffers[uv_view.buffer]
+                          .data[uv_accessor.byteOffset +
+                                uv_view.byteOffset]));
+            }
+
+            for (size_t i = 0; i < accessor.count; ++i) {
+                // Positions are Vec3 components, so for each vec3 stride,
+                // offset for x, y, and z.
+                // std::cout << "(" << positions[i * 3 + 0] << ", " // x
+                //           << positions[i * 3 + 1] << ", "        // y
+                //           << positions[i * 3 + 2] << ")"         // z
+                //           << "\n";
+                Vertex v = Vertex{
+                    positions[i * 3 + 0], positions[i * 3 + 1],
+                    positions[i * 3 + 2], buffer_texture_coords[i * 2],
+                    buffer_texture_coords[i * 2 + 1]};
+                vertex_buffer.emplace_back(v);
+            }
+            vertex_count += static_cast<uint32_t>(accessor.count);
+        }
+        {
+            const tinygltf::Accessor &accessor =
+                model.accessors[primitive.indices];
+            const tinygltf::BufferView &buffer_view =
+                model.bufferViews[accessor.bufferView];
+            const tinygltf::Buffer &buffer =
+                model.buffers[buffer_view.buffer];
+
+            index_count = static_cast<uint32_t>(accessor.count);
+            switch (accessor.componentType) {
+            case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
+                auto *buf = new uint32_t[accessor.count];
+                memcpy(buf,
+                       &buffer.data[accessor.byteOffset +
+                                    buffer_view.byteOffset],
+                       accessor.count * sizeof(uint32_t));
+                for (size_t index = 0; index < accessor.count; index++) {
+                    index_buffer.emplace_back(buf[index]);
+                }
+                delete[] buf;
+                break;
+            }
+            case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
+                auto *buf = new uint16_t[accessor.count];
+                memcpy(buf,
+                       &buffer.data[accessor.byteOffset +
+                                    buffer_view.byteOffset],
+                       accessor.count * sizeof(uint16_t));
+                for (size_t index = 0; index < accessor.count; index++) {
+                    index_buffer.emplace_back(buf[index]);
+                }
+                delete[] buf;
+                break;
+            }
+            case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
+                auto *buf = new uint8_t[accessor.count];
+                memcpy(buf,
+                       &buffer.data[accessor.byteOffset +
+                                    buffer_view.byteOffset],
+                       accessor.count * sizeof(uint8_t));
+                for (size_t index = 0; index < accessor.count; index++) {
+                    index_buffer.emplace_back(buf[index]);
+                }
+                delete[] buf;
+                break;
+            }
+            default:
+                std::cerr << "Index component type "
+                          << accessor.componentType << " not supported!"
+                          << std::endl;
+                return {};
+            }
+        }
+        {
+            for (size_t i = 0; i < index_count; i += 3) {
+                Vertex v1_with_uv = vertex_buffer[index_buffer[i]];
+                Vertex v2_with_uv = vertex_buffer[index_buffer[1 + i]];
+                Vertex v3_with_uv = vertex_buffer[index_buffer[2 + i]];
+                Vec3 v1 = Vec3{v1_with_uv.x, v1_with_uv.y, v1_with_uv.z};
+                Vec3 v2 = Vec3{v2_with_uv.x, v2_with_uv.y, v2_with_uv.z};
+                Vec3 v3 = Vec3{v3_with_uv.x, v3_with_uv.y, v3_with_uv.z};
+                Vec2 uv1 = Vec2{v1_with_uv.uv_x, v1_with_uv.uv_y};
+                Vec2 uv2 = Vec2{v2_with_uv.uv_x, v2_with_uv.uv_y};
+                Vec2 uv3 = Vec2{v3_with_uv.uv_x, v3_with_uv.uv_y};
+                uint32_t texture_id = std::numeric_limits<uint32_t>::max();
+                uint32_t metallic_roughness_texture_id =
+                    std::numeric_limits<uint32_t>::max();
+                Vec3 emissive_factor = Vec3{0.0, 0.0, 0.0};
+                Vec4 base_color_factor = Vec4{1.0, 1.0, 1.0, 1.0};
+                double metallic_factor = 0.5;
+                double roughness_factor = 0.5;
+                double alpha_cutoff = 0;
+                bool double_sided = true;
+                uint32_t material_id = primitive_material_id(
+                    primitive.material, buffer_texture_coords != nullptr,
+                    model.materials.size());
+                if (static_cast<size_t>(primitive.material) <
+                    model.materials.size()) {
+                    if (buffer_texture_coords != nullptr) {
+                        texture_id = model.materials[primitive.material]
+                                         .pbrMetallicRoughness
+                                         .baseColorTexture.index;
+                        metallic_roughness_texture_id =
+                            model.materials[primitive.material]
+                                .pbrMetallicRoughness
+                                .metallicRoughnessTexture.index;
+                        base_color_factor = make_vec4(
+                            model.materials[primitive.material]
+                                .pbrMetallicRoughness.baseColorFactor);
+                    }
+                    emissive_factor = make_vec3(
+                        model.materials[primitive.material].emissiveFactor);
+                    metallic_factor =
+                        model.materials[primitive.material]
+                            .pbrMetallicRoughness.metallicFactor;
+                    roughness_factor =
+                        model.materials[primitive.material]
+                            .pbrMetallicRoughness.roughnessFactor;
+                    alpha_cutoff = material_alpha_cutoff(
+                        model.materials[primitive.material]);
+                    double_sided =
+                        model.materials[primitive.material].doubleSided;
+                }
+                Triangle triangle{v1,
+                                  v2,
+                                  v3,
+                                  uv1,
+                                  uv2,
+                                  uv3,
+                                  texture_id,
+                                  metallic_roughness_texture_id,
+                                  metallic_factor,
+                                  roughness_factor,
+                                  alpha_cutoff,
+                                  double_sided,
+                                  emissive_factor,
+                                  base_color_factor,
+                                  {first_vertex + index_buffer[i],
+                                   first_vertex + index_buffer[1 + i],
+                                   first_vertex + index_buffer[2 + i]},
+                                  material_id};
+                triangles.emplace_back(triangle);
+            }
+        }
+    }
+    return triangles;
+}
+
+void mark_used_meshes(const tinygltf::Model &model, int node_id,
+                      std::vector<bool> &used) {
+    const tinygltf::Node &node = model.nodes[node_id];
+    if (node.mesh > -1) {
+        used[node.mesh] = true;
+    }
+    for (int child : node.children) {
+        mark_used_meshes(model, child, used);
+    }
+}
+
 void load_node(OurNode *parent, const tinygltf::Node &node,
                const tinygltf::Model &model, float global_scale) {
     auto new_node = OurNode{};
@@ -213,185 +421,8 @@ void load_node(OurNode *parent, const tinygltf::Node &node,
         }
     }
 
-    // Node contains mesh data
-    if (node.mesh > -1) {
-        const tinygltf::Mesh mesh = model.meshes[node.mesh];
-
-        for (const auto &primitive : mesh.primitives) {
-            if (primitive.mode != TINYGLTF_MODE_TRIANGLES) {
-                std::cout << "Warning: primitive.mode is not triangles"
-                          << std::endl;
-                continue;
-            }
-            if (primitive.indices == -1) {
-                std::cout << "Warning: primitive.indices == -1; skipping"
-                          << std::endl;
-                continue;
-            }
-            uint32_t index_count = 0;
-
-            std::vector<Vertex> vertex_buffer = std::vector<Vertex>();
-            std::vector<uint32_t> index_buffer = std::vector<uint32_t>();
-
-            const float *buffer_texture_coords;
-            {
-                const tinygltf::Accessor &accessor =
-                    model.accessors[primitive.attributes.at("POSITION")];
-
-                const tinygltf::BufferView &buffer_view =
-                    model.bufferViews[accessor.bufferView];
-                const tinygltf::Buffer &buffer =
-                    model.buffers[buffer_view.buffer];
-                const float *positions = reinterpret_cast<const float *>(
-                    &buffer.data[buffer_view.byteOffset + accessor.byteOffset]);
-
-                buffer_texture_coords = nullptr;
-                if (primitive.attributes.find("TEXCOORD_0") !=
-                    primitive.attributes.end()) {
-                    const tinygltf::Accessor &uv_accessor =
-                        model.accessors[primitive.attributes.find("TEXCOORD_0")
-                                            ->second];
-                    const tinygltf::BufferView &uv_view =
-                        model.bufferViews[uv_accessor.bufferView];
-                    buffer_texture_coords = reinterpret_cast<const float *>(
-                        &(model.buffers[uv_view.buffer]
-                              .data[uv_accessor.byteOffset +
-                                    uv_view.byteOffset]));
-                }
-
-                for (size_t i = 0; i < accessor.count; ++i) {
-                    // Positions are Vec3 components, so for each vec3 stride,
-                    // offset for x, y, and z.
-                    // std::cout << "(" << positions[i * 3 + 0] << ", " // x
-                    //           << positions[i * 3 + 1] << ", "        // y
-                    //           << positions[i * 3 + 2] << ")"         // z
-                    //           << "\n";
-                    Vertex v = Vertex{
-                        positions[i * 3 + 0], positions[i * 3 + 1],
-                        positions[i * 3 + 2], buffer_texture_coords[i * 2],
-                        buffer_texture_coords[i * 2 + 1]};
-                    vertex_buffer.emplace_back(v);
-                }
-            }
-            {
-                const tinygltf::Accessor &accessor =
-                    model.accessors[primitive.indices];
-                const tinygltf::BufferView &buffer_view =
-                    model.bufferViews[accessor.bufferView];
-                const tinygltf::Buffer &buffer =
-                    model.buffers[buffer_view.buffer];
-
-                index_count = static_cast<uint32_t>(accessor.count);
-                switch (accessor.componentType) {
-                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-                    auto *buf = new uint32_t[accessor.count];
-                    memcpy(buf,
-                           &buffer.data[accessor.byteOffset +
-                                        buffer_view.byteOffset],
-                           accessor.count * sizeof(uint32_t));
-                    for (size_t index = 0; index < accessor.count; index++) {
-                        index_buffer.emplace_back(buf[index]);
-                    }
-                    delete[] buf;
-                    break;
-                }
-                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-                    auto *buf = new uint16_t[accessor.count];
-                    memcpy(buf,
-                           &buffer.data[accessor.byteOffset +
-                                        buffer_view.byteOffset],
-                           accessor.count * sizeof(uint16_t));
-                    for (size_t index = 0; index < accessor.count; index++) {
-                        index_buffer.emplace_back(buf[index]);
-                    }
-                    delete[] buf;
-                    break;
-                }
-                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-                    auto *buf = new uint8_t[accessor.count];
-                    memcpy(buf,
-                           &buffer.data[accessor.byteOffset +
-                                        buffer_view.byteOffset],
-                           accessor.count * sizeof(uint8_t));
-                    for (size_t index = 0; index < accessor.count; index++) {
-                        index_buffer.emplace_back(buf[index]);
-                    }
-                    delete[] buf;
-                    break;
-                }
-                default:
-                    std::cerr << "Index component type "
-                              << accessor.componentType << " not supported!"
-                              << std::endl;
-                    return;
-                }
-            }
-            {
-                for (size_t i = 0; i < index_count; i += 3) {
-                    Vertex v1_with_uv = vertex_buffer[index_buffer[i]];
-                    Vertex v2_with_uv = vertex_buffer[index_buffer[1 + i]];
-                    Vertex v3_with_uv = vertex_buffer[index_buffer[2 + i]];
-                    Vec3 v1 = Vec3{v1_with_uv.x, v1_with_uv.y, v1_with_uv.z};
-                    Vec3 v2 = Vec3{v2_with_uv.x, v2_with_uv.y, v2_with_uv.z};
-                    Vec3 v3 = Vec3{v3_with_uv.x, v3_with_uv.y, v3_with_uv.z};
-                    Vec2 uv1 = Vec2{v1_with_uv.uv_x, v1_with_uv.uv_y};
-                    Vec2 uv2 = Vec2{v2_with_uv.uv_x, v2_with_uv.uv_y};
-                    Vec2 uv3 = Vec2{v3_with_uv.uv_x, v3_with_uv.uv_y};
-                    uint32_t texture_id = std::numeric_limits<uint32_t>::max();
-                    uint32_t metallic_roughness_texture_id =
-                        std::numeric_limits<uint32_t>::max();
-                    Vec3 emissive_factor = Vec3{0.0, 0.0, 0.0};
-                    Vec4 base_color_factor = Vec4{1.0, 1.0, 1.0, 1.0};
-                    double metallic_factor = 0.5;
-                    double roughness_factor = 0.5;
-                    double alpha_cutoff = 0.5;
-                    bool double_sided = true;
-                    if (static_cast<size_t>(primitive.material) <
-                        model.materials.size()) {
-                        if (buffer_texture_coords != nullptr) {
-                            texture_id = model.materials[primitive.material]
-                                             .pbrMetallicRoughness
-                                             .baseColorTexture.index;
-                            metallic_roughness_texture_id =
-                                model.materials[primitive.material]
-                                    .pbrMetallicRoughness
-                                    .metallicRoughnessTexture.index;
-                            base_color_factor = make_vec4(
-                                model.materials[primitive.material]
-                                    .pbrMetallicRoughness.baseColorFactor);
-                        }
-                        emissive_factor = make_vec3(
-                            model.materials[primitive.material].emissiveFactor);
-                        metallic_factor =
-                            model.materials[primitive.material]
-                                .pbrMetallicRoughness.metallicFactor;
-                        roughness_factor =
-                            model.materials[primitive.material]
-                                .pbrMetallicRoughness.roughnessFactor;
-                        alpha_cutoff =
-                            model.materials[primitive.material].alphaCutoff;
-                        double_sided =
-                            model.materials[primitive.material].doubleSided;
-                    }
-                    Triangle triangle{v1,
-                                      v2,
-                                      v3,
-                                      uv1,
-                                      uv2,
-                                      uv3,
-                                      texture_id,
-                                      metallic_roughness_texture_id,
-                                      metallic_factor,
-                                      roughness_factor,
-                                      alpha_cutoff,
-                                      double_sided,
-                                      emissive_factor,
-                                      base_color_factor};
-                    new_node.primitives.emplace_back(triangle);
-                }
-            }
-        }
-    }
+    // Node references mesh data, load_model loads every mesh only once
+    new_node.mesh = node.mesh;
     parent->children.emplace_back(new_node);
 }
 
@@ -447,6 +478,20 @@ OurNode load_model(std::string filename) {
         load_node(&root_node, node, gltf_model, scale);
     }
 
+    std::vector<bool> used_meshes(gltf_model.meshes.size());
+    for (const auto &node_idx : scene.nodes) {
+        mark_used_meshes(gltf_model, node_idx, used_meshes);
+    }
+    root_node.materials = gltf_model.materials;
+    root_node.meshes.resize(gltf_model.meshes.size());
+    root_node.mesh_vertices.resize(gltf_model.meshes.size());
+    for (size_t i = 0; i < gltf_model.meshes.size(); ++i) {
+        if (used_meshes[i]) {
+            root_node.meshes[i] = load_mesh(gltf_model.meshes[i], gltf_model,
+                                            root_node.mesh_vertices[i]);
+        }
+    }
+
 #ifdef DEBUG_PRINT
     std::cout << "[" << std::endl;
     print_node(rootNode);
@@ -499,60 +544,189 @@ PaddedVec3ForGLSL v3_max(const PaddedVec3ForGLSL &v1,
                              std::max(v1.z, std::max(v2.z, v3.z)), 0};
 }
 
-std::vector<TriangleForGLSL *> node_to_triangles(const OurNode &node) {
-    std::vector<TriangleForGLSL *> triangles = {};
-    for (const auto &primitive : node.primitives) {
-        PaddedVec3ForGLSL v1_transformed =
-            transform4(node.matrix, primitive.v1);
-        PaddedVec3ForGLSL v2_transformed =
-            transform4(node.matrix, primitive.v2);
-        PaddedVec3ForGLSL v3_transformed =
-            transform4(node.matrix, primitive.v3);
-        PaddedVec3ForGLSL min_transformed =
-            v3_min(v1_transformed, v2_transformed, v3_transformed);
-        PaddedVec3ForGLSL max_transformed =
-            v3_max(v1_transformed, v2_transformed, v3_transformed);
-        Vec2ForGLSL uv1 = Vec2ForGLSL{static_cast<float>(primitive.uv1.x),
-                                      static_cast<float>(primitive.uv1.y)};
-        Vec2ForGLSL uv2 = Vec2ForGLSL{static_cast<float>(primitive.uv2.x),
-                                      static_cast<float>(primitive.uv2.y)};
-        Vec2ForGLSL uv3 = Vec2ForGLSL{static_cast<float>(primitive.uv3.x),
-                                      static_cast<float>(primitive.uv3.y)};
-        uint32_t texture_id = primitive.texture_id;
-        uint32_t metallic_roughness_texture_id =
-            primitive.metallic_roughness_texture_id;
-        float metallic_factor = static_cast<float>(primitive.metallic_factor);
-        float roughness_factor = static_cast<float>(primitive.roughness_factor);
-        float alpha_cutoff = static_cast<float>(primitive.alpha_cutoff);
-        uint32_t double_sided = static_cast<uint32_t>(primitive.double_sided);
-        PaddedVec3ForGLSL emissive_factor = PaddedVec3ForGLSL{
-            static_cast<float>(primitive.emissive_factor.x),
-            static_cast<float>(primitive.emissive_factor.y),
-            static_cast<float>(primitive.emissive_factor.z), 0};
-        Vec4ForGLSL base_color_factor =
-            Vec4ForGLSL{static_cast<float>(primitive.base_color_factor.x),
-                        static_cast<float>(primitive.base_color_factor.y),
-                        static_cast<float>(primitive.base_color_factor.z),
-                        static_cast<float>(primitive.base_color_factor.w)};
-        triangles.emplace_back(new TriangleForGLSL{
-            v1_transformed, v2_transformed, v3_transformed, min_transformed,
-            max_transformed, uv1, uv2, uv3, texture_id,
-            metallic_roughness_texture_id, metallic_factor, roughness_factor,
-            alpha_cutoff, double_sided, emissive_factor, base_color_factor});
+TriangleForGLSL triangle_for_glsl(const Triangle &primitive,
+                                  const Matrix4 &matrix) {
+    PaddedVec3ForGLSL v1_transformed = transform4(matrix, primitive.v1);
+    PaddedVec3ForGLSL v2_transformed = transform4(matrix, primitive.v2);
+    PaddedVec3ForGLSL v3_transformed = transform4(matrix, primitive.v3);
+    PaddedVec3ForGLSL min_transformed =
+        v3_min(v1_transformed, v2_transformed, v3_transformed);
+    PaddedVec3ForGLSL max_transformed =
+        v3_max(v1_transformed, v2_transformed, v3_transformed);
+    Vec2ForGLSL uv1 = Vec2ForGLSL{static_cast<float>(primitive.uv1.x),
+                                  static_cast<float>(primitive.uv1.y)};
+    Vec2ForGLSL uv2 = Vec2ForGLSL{static_cast<float>(primitive.uv2.x),
+                                  static_cast<float>(primitive.uv2.y)};
+    Vec2ForGLSL uv3 = Vec2ForGLSL{static_cast<float>(primitive.uv3.x),
+                                  static_cast<float>(primitive.uv3.y)};
+    uint32_t texture_id = primitive.texture_id;
+    uint32_t metallic_roughness_texture_id =
+        primitive.metallic_roughness_texture_id;
+    float metallic_factor = static_cast<float>(primitive.metallic_factor);
+    float roughness_factor = static_cast<float>(primitive.roughness_factor);
+    float alpha_cutoff = static_cast<float>(primitive.alpha_cutoff);
+    uint32_t double_sided = static_cast<uint32_t>(primitive.double_sided);
+    Vec3ForGLSL emissive_factor =
+        Vec3ForGLSL{static_cast<float>(primitive.emissive_factor.x),
+                    static_cast<float>(primitive.emissive_factor.y),
+                    static_cast<float>(primitive.emissive_factor.z)};
+    Vec4ForGLSL base_color_factor =
+        Vec4ForGLSL{static_cast<float>(primitive.base_color_factor.x),
+                    static_cast<float>(primitive.base_color_factor.y),
+                    static_cast<float>(primitive.base_color_factor.z),
+                    static_cast<float>(primitive.base_color_factor.w)};
+    return TriangleForGLSL{
+        v1_transformed, v2_transformed, v3_transformed, min_transformed,
+        max_transformed, uv1, uv2, uv3, texture_id,
+        metallic_roughness_texture_id, metallic_factor, roughness_factor,
+        alpha_cutoff, double_sided, emissive_factor, primitive.material_id,
+        base_color_factor};
+}
+
+size_t count_node_triangles(const OurNode &node,
+                            const std::vector<std::vector<Triangle>> &meshes) {
+    size_t count = node.mesh > -1 ? meshes[node.mesh].size() : 0;
+    for (const auto &child : node.children) {
+        count += count_node_triangles(child, meshes);
+    }
+    return count;
+}
+
+size_t count_node_triangles(const OurNode &node) {
+    return count_node_triangles(node, node.meshes);
+}
+
+// `vertex_ids` and `vertex_count` are null when the ids are not kept
+void node_to_triangles(const OurNode &node, const OurNode &root,
+                       std::vector<TriangleForGLSL> &triangles,
+                       std::vector<TriangleVertexIds> *vertex_ids,
+                       uint32_t *vertex_count) {
+    if (node.mesh > -1) {
+        for (const auto &primitive : root.meshes[node.mesh]) {
+            triangles.push_back(triangle_for_glsl(primitive, node.matrix));
+        }
+        if (vertex_ids != nullptr) {
+            uint32_t first = *vertex_count;
+            for (const auto &primitive : root.meshes[node.mesh]) {
+                const TriangleVertexIds &ids = primitive.vertex_ids;
+                vertex_ids->push_back(TriangleVertexIds{
+                    first + ids.v1, first + ids.v2, first + ids.v3});
+            }
+            *vertex_count += root.mesh_vertices[node.mesh];
+        }
     }
     for (const auto &child : node.children) {
-        std::vector<TriangleForGLSL *> new_triangles = node_to_triangles(child);
-        for (auto &triangle : new_triangles) {
-            triangle->v1 = transform4(node.matrix, triangle->v1);
-            triangle->v2 = transform4(node.matrix, triangle->v2);
-            triangle->v3 = transform4(node.matrix, triangle->v3);
-            triangle->min = v3_min(triangle->v1, triangle->v2, triangle->v3);
-            triangle->max = v3_max(triangle->v1, triangle->v2, triangle->v3);
+        // The subtree of every child is appended in its own space, then
+        // moved into the space of this node
+        size_t first = triangles.size();
+        node_to_triangles(child, root, triangles, vertex_ids, vertex_count);
+        for (size_t i = first; i < triangles.size(); ++i) {
+            TriangleForGLSL &triangle = triangles[i];
+            triangle.v1 = transform4(node.matrix, triangle.v1);
+            triangle.v2 = transform4(node.matrix, triangle.v2);
+            triangle.v3 = transform4(node.matrix, triangle.v3);
+            triangle.min = v3_min(triangle.v1, triangle.v2, triangle.v3);
+            triangle.max = v3_max(triangle.v1, triangle.v2, triangle.v3);
         }
-        triangles.reserve(triangles.size() + new_triangles.size());
-        triangles.insert(triangles.end(),
-                         std::make_move_iterator(new_triangles.begin()),
-                         std::make_move_iterator(new_triangles.end()));
     }
-    return triangles;
+}
+
+void node_to_triangles(const OurNode &node,
+                       std::vector<TriangleForGLSL> &triangles) {
+    triangles.reserve(triangles.size() + count_node_triangles(node));
+    node_to_triangles(node, node, triangles, nullptr, nullptr);
+}
+
+void node_to_triangles(const OurNode &node,
+                       std::vector<TriangleForGLSL> &triangles,
+                       std::vector<TriangleVertexIds> &vertex_ids,
+                       uint32_t &vertex_count) {
+    size_t count = count_node_triangles(node);
+    triangles.reserve(triangles.size() + count);
+    vertex_ids.reserve(vertex_ids.size() + count);
+    node_to_triangles(node, node, triangles, &vertex_ids, &vertex_count);
+}
+
+std::vector<TriangleForGLSL *>
+triangle_pointers(std::vector<TriangleForGLSL> &triangles) {
+    std::vector<TriangleForGLSL *> pointers(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        pointers[i] = &triangles[i];
+    }
+    return pointers;
+}
+
+std::vector<uint32_t>
+order_triangles(std::vector<TriangleForGLSL> &triangles,
+                std::vector<TriangleForGLSL *> &references,
+                std::vector<TriangleVertexIds> &vertex_ids) {
+    bool with_ids = !vertex_ids.empty();
+    // Slot of every referenced triangle, in the order of its first
+    // reference, and the triangle every slot takes
+    const uint32_t unplaced = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> placed(triangles.size(), unplaced);
+    std::vector<uint32_t> source;
+    source.reserve(triangles.size());
+    std::vector<uint32_t> indices(references.size());
+    for (size_t i = 0; i < references.size(); ++i) {
+        size_t from = references[i] - triangles.data();
+        if (placed[from] == unplaced) {
+            placed[from] = source.size();
+            source.push_back(from);
+        }
+        indices[i] = placed[from];
+    }
+    size_t count = source.size();
+    auto move = [&](size_t to, size_t from) {
+        triangles[to] = triangles[from];
+        if (with_ids) {
+            vertex_ids[to] = vertex_ids[from];
+        }
+    };
+    // A slot holding a triangle no reference points to is free: the chain
+    // of moves from it ends past the last slot, where nothing is kept
+    for (size_t start = 0; start < count; ++start) {
+        if (placed[start] != unplaced) {
+            continue;
+        }
+        size_t i = start;
+        while (i < count) {
+            move(i, source[i]);
+            size_t next = source[i];
+            source[i] = i;
+            i = next;
+        }
+    }
+    // The other slots form cycles, each rotated holding one triangle aside
+    for (size_t start = 0; start < count; ++start) {
+        if (source[start] == start) {
+            continue;
+        }
+        TriangleForGLSL held = triangles[start];
+        TriangleVertexIds held_ids =
+            with_ids ? vertex_ids[start] : TriangleVertexIds{};
+        size_t i = start;
+        while (source[i] != start) {
+            move(i, source[i]);
+            size_t next = source[i];
+            source[i] = i;
+            i = next;
+        }
+        triangles[i] = held;
+        if (with_ids) {
+            vertex_ids[i] = held_ids;
+        }
+        source[i] = i;
+    }
+    triangles.resize(count);
+    if (with_ids) {
+        vertex_ids.resize(count);
+    }
+    for (size_t i = 0; i < references.size(); ++i) {
+        references[i] = &triangles[indices[i]];
+    }
+    if (references.size() == count) {
+        return {};
+    }
+    return indices;
 }
@@ -13,14 +13,35 @@
 #include <string>
 
 #include "./aabb.hpp"
+#include "./benchmark.hpp"
+#include "./bvh_cache.hpp"
 #include "./controls.hpp"
+#include "./dynamic_bvh.hpp"
+#include "./layout.hpp"
 #include "./load_model.hpp"
+#include "./material_table.hpp"
+#include "./options.hpp"
+#include "./quantized_bvh.hpp"
+#include "./scene.hpp"
+#include "./ssbo.hpp"
+#include "./stackless.hpp"
+#include "./stats.hpp"
+#include "./treelet.hpp"
+#include "./triangle_streams.hpp"
 #include "./use_opengl.h"
+#include "./view_bvh.hpp"
+#include "./wide_bvh.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void process_input(GLFWwindow *window);
+bool key_pressed(GLFWwindow *window, int key, bool &was_down);
+// Inserts the model as a batch and returns its id, or -1 for a textured
+// model. Its materials are appended to `materials`.
+int stream_model(DynamicBVH &bvh, const std::string &path, int builder,
+                 const BuildParams &params,
+                 std::vector<MaterialForGLSL> &materials, ThreadPool &pool);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -44,53 +65,75 @@ const char *read_shader(std::string filename) {
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cout << "Usage: " << argv[0]
-                  << " <shader file> [<gltf_file>...] [<glb_file>...] ... "
-                     "[mode=<mouse|arrows>] "
-                  << std::endl;
+    Options options;
+    // The stats JSON keeps stdout to itself, everything else is logged to
+    // stderr then
+    std::streambuf *stdout_buffer = std::cout.rdbuf();
+    if (stats_to_stdout(argc, argv)) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
         return 1;
     }
-    std::string shader_path = argv[1];
+    std::string shader_path = options.shader_path;
+    // Every triangle of the flat and dynamic scenes, in load order until
+    // order_triangles puts it in leaf order; `triangles` points into it
+    std::vector<TriangleForGLSL> triangle_arena;
     std::vector<TriangleForGLSL *> triangles;
+    // Vertices of every triangle of the arena in the glTF index buffers,
+    // what triangles=indexed welds back together
+    std::vector<TriangleVertexIds> vertex_ids;
+    uint32_t vertex_count = 0;
+    // Materials of every file of the flat scene, what the material_id of
+    // its triangles index
+    std::vector<MaterialForGLSL> materials;
     std::vector<tinygltf::Image> textures;
     tinygltf::Image environment_texture;
 #ifdef DEBUG_PRINT
     auto start_model = std::chrono::high_resolution_clock::now();
 #endif
-    std::string sky_path = "";
-    std::string last_arg = argv[argc - 1];
-    int mode = MODE_MOUSE;
-    if (last_arg.find("mode=") != std::string::npos) {
-        argc--;
-        std::string mode_arg = last_arg.substr(5);
-        last_arg = argv[argc - 1];
-        if (mode_arg == "arrows") {
-            mode = MODE_ARROWS;
-        }
-        if(last_arg.find("sky=") != std::string::npos) {
-            argc--;
-            sky_path = last_arg.substr(4);
-        }
-    }
-    else if(last_arg.find("sky=") != std::string::npos) {
-        argc--;
-        sky_path = last_arg.substr(4);
-    }
-    
-
-    for (int i = 2; i < argc; ++i) {
-        std::string path = argv[i];
+    std::string sky_path = options.sky_path;
+    int mode = options.mode;
+
+    // Benchmarks always run on the flat triangle list
+    bool instanced =
+        options.scene == SCENE_INSTANCED && options.bench.empty();
+    bool dynamic = options.scene == SCENE_DYNAMIC && options.bench.empty();
+    Scene scene;
+    // Triangles each model added, scene=dynamic inserts them as batches
+    std::vector<FileStats> file_stats;
+
+    for (const auto &path : options.model_paths) {
         OurNode model = load_model(path);
-        std::vector<TriangleForGLSL *> new_triangles = node_to_triangles(model);
-        triangles.reserve(triangles.size() + new_triangles.size());
-        triangles.insert(triangles.end(),
-                         std::make_move_iterator(new_triangles.begin()),
-                         std::make_move_iterator(new_triangles.end()));
+        if (instanced) {
+            size_t first_instance = scene.instances.size();
+            add_node_to_scene(scene, model);
+            size_t instanced_triangles = 0;
+            for (size_t i = first_instance; i < scene.instances.size(); ++i) {
+                instanced_triangles +=
+                    scene.meshes[scene.instances[i].mesh_id].triangles.size();
+            }
+            file_stats.push_back(FileStats{path, instanced_triangles});
+        } else {
+            size_t first = triangle_arena.size();
+            node_to_triangles(model, triangle_arena, vertex_ids,
+                              vertex_count);
+            // The material ids of every file start after those of the
+            // previous ones
+            uint32_t material_offset = materials.size();
+            append_materials(model.materials, materials);
+            for (size_t i = first; i < triangle_arena.size(); ++i) {
+                triangle_arena[i].material_id += material_offset;
+            }
+            file_stats.push_back(
+                FileStats{path, triangle_arena.size() - first});
+        }
         for (size_t j = 0; j < model.images.size(); ++j) {
             textures.emplace_back(model.images[j]);
         }
     }
+    triangles = triangle_pointers(triangle_arena);
     OurNode sky_model;
     if(sky_path!="") {
         sky_model = load_model(sky_path);
@@ -117,21 +160,275 @@ int main(int argc, char *argv[]) {
     std::cout << "]" << std::endl;
 #endif
 
-#ifdef DEBUG_PRINT
+    if (!options.bench.empty()) {
+        bool known =
+            run_benchmark(triangles, vertex_ids, materials, options);
+        return known ? 0 : 1;
+    }
+
+    ThreadPool pool(options.threads);
     auto start_aabb = std::chrono::high_resolution_clock::now();
-#endif
+    const BuildParams &build_params = options.build_params;
     std::vector<Box> boxes;
-    AABB *aabb = triangles_to_aabb(boxes, triangles, 0, triangles.size(), 0);
-#ifdef DEBUG_PRINT
-    auto end_aabb = std::chrono::high_resolution_clock::now();
-    std::cout << "AABB construction took "
-              << std::chrono::duration_cast<std::chrono::milliseconds>(
-                     end_aabb - start_aabb)
-                     .count()
-              << "ms" << std::endl;
-#endif
+    AABB *aabb;
+    int triangle_count = triangles.size();
+    DynamicBVH dynamic_bvh;
+    // Batches of the stream= models, the last inserted last
+    std::vector<int> streamed_batches;
+    size_t next_stream = 0;
+    // triangles=split and triangles=indexed: what the flat scene uploads in
+    // place of its triangles
+    std::vector<TriangleGeometry> triangle_geometry;
+    std::vector<TriangleEdges> triangle_edges;
+    std::vector<PaddedVec3ForGLSL> welded_vertices;
+    std::vector<TriangleIndices> triangle_indices;
+    std::vector<TriangleAttributes> triangle_attributes;
+    // sbvh and clip=: the triangle of every leaf reference, each triangle is
+    // uploaded once
+    std::vector<uint32_t> reference_indices;
+    // nodes=, width= and traversal=stackless: built with the flat tree so
+    // the stats count them, uploaded next to its boxes
+    std::vector<WideBox<4>> wide4;
+    std::vector<WideBox<8>> wide8;
+    std::vector<QuantizedBox> quantized;
+    std::vector<StacklessLink> links;
+    if (instanced) {
+        build_blas(scene, options.builder, build_params, pool);
+        auto start_tlas = std::chrono::high_resolution_clock::now();
+        build_tlas(scene);
+        auto end_tlas = std::chrono::high_resolution_clock::now();
+        aabb = new AABB{scene.tlas_root_id};
+        size_t blas_nodes = 0;
+        triangle_count = 0;
+        for (const auto &mesh : scene.meshes) {
+            blas_nodes += mesh.boxes.size();
+            triangle_count += mesh.triangles.size();
+        }
+        std::cout << "BVH builder: " << builder_name(options.builder) << ", "
+                  << scene.meshes.size() << " meshes with " << blas_nodes
+                  << " nodes and " << triangle_count
+                  << " triangle references built in "
+                  << std::chrono::duration<double, std::milli>(start_tlas -
+                                                               start_aabb)
+                         .count()
+                  << "ms, TLAS over " << scene.instances.size()
+                  << " instances built in "
+                  << std::chrono::duration<double, std::milli>(end_tlas -
+                                                               start_tlas)
+                         .count()
+                  << "ms" << std::endl;
+    } else if (dynamic) {
+        size_t start = 0;
+        for (const auto &file : file_stats) {
+            insert_batch(dynamic_bvh,
+                         std::vector<TriangleForGLSL *>(
+                             triangles.begin() + start,
+                             triangles.begin() + start + file.triangles),
+                         options.builder, build_params, pool);
+            start += file.triangles;
+        }
+        aabb = new AABB{dynamic_bvh.root_id};
+        triangle_count = dynamic_bvh.triangles.size();
+        double build_ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::high_resolution_clock::now() -
+                              start_aabb)
+                              .count();
+        std::cout << "Dynamic BVH: " << file_stats.size() << " batches, "
+                  << dynamic_bvh.boxes.size() << " nodes, SAH cost "
+                  << sah_cost(dynamic_bvh.boxes, aabb->root_id, build_params)
+                  << ", built in " << build_ms << "ms. Press I to insert the "
+                  << "next stream= model, O to remove the last one"
+                  << std::endl;
+    } else {
+        std::vector<CameraView> views;
+        if (!options.views_path.empty()) {
+            views = load_views(options.views_path);
+        }
+        // The cache key does not cover the views. Until order_triangles the
+        // arena stays in load order, which the cache indexes.
+        bool use_cache = views.empty() && !options.cache_dir.empty() &&
+                         options.cache_dir != "none";
+        uint64_t cache_key = 0;
+        int cached_root_id = -1;
+        bool cached = false;
+        if (use_cache) {
+            cache_key = bvh_cache_key(triangles, options.builder,
+                                      build_params, options.treelet_passes,
+                                      pool);
+            cached = load_cached_bvh(options.cache_dir, cache_key,
+                                     triangle_pointers(triangle_arena), boxes,
+                                     triangles, cached_root_id);
+        }
+        if (cached) {
+            aabb = new AABB{cached_root_id};
+            std::cout << "BVH loaded from "
+                      << bvh_cache_path(options.cache_dir, cache_key)
+                      << std::endl;
+        } else {
+            if (!views.empty()) {
+                std::vector<Ray> rays = sample_view_rays(views);
+                aabb = triangles_to_aabb_views(boxes, triangles, rays,
+                                               build_params, pool);
+                std::cout << "BVH built for " << views.size()
+                          << " views from " << options.views_path << " with "
+                          << rays.size() << " sample rays" << std::endl;
+            } else {
+                aabb = build_aabb(boxes, triangles, options.builder,
+                                  build_params, pool);
+            }
+            if (options.treelet_passes > 0) {
+                std::vector<float> costs =
+                    optimize_treelets(boxes, triangles, *aabb, build_params,
+                                      options.treelet_passes, pool);
+                for (size_t pass = 1; pass < costs.size(); ++pass) {
+                    std::cout << "Treelet pass " << pass << ": SAH cost "
+                              << costs[pass - 1] << " -> " << costs[pass]
+                              << std::endl;
+                }
+            }
+            if (use_cache &&
+                !save_cached_bvh(options.cache_dir, cache_key,
+                                 triangle_pointers(triangle_arena), boxes,
+                                 triangles, aabb->root_id)) {
+                std::cerr << "Could not write the BVH cache to "
+                          << options.cache_dir << std::endl;
+            }
+        }
+        if (options.layout != LAYOUT_POST_ORDER) {
+            aabb->root_id =
+                relayout_bvh(boxes, aabb->root_id, options.layout);
+        }
+        auto end_aabb = std::chrono::high_resolution_clock::now();
+        double build_ms = std::chrono::duration<double, std::milli>(
+                              end_aabb - start_aabb)
+                              .count();
+        float cost = sah_cost(boxes, aabb->root_id, build_params);
+        std::cout << "BVH builder: " << builder_name(options.builder) << ", "
+                  << boxes.size() << " nodes, " << triangles.size()
+                  << " triangle references, SAH cost " << cost
+                  << ", built in " << build_ms << "ms ("
+                  << triangle_arena.size() / (build_ms * 1000.0)
+                  << " Mtri/s) on " << pool.size() << " threads" << std::endl;
+        if (options.builder != BUILDER_MEDIAN || !views.empty()) {
+            // The median tree is the baseline the other builders are
+            // measured against, built aside over the load order
+            std::vector<Box> median_boxes;
+            std::vector<TriangleForGLSL *> median_triangles =
+                triangle_pointers(triangle_arena);
+            BuildParams median_params = build_params;
+            median_params.clip_budget = 0;
+            AABB *median = build_aabb(median_boxes, median_triangles,
+                                      BUILDER_MEDIAN, median_params, pool);
+            float median_cost =
+                sah_cost(median_boxes, median->root_id, build_params);
+            delete median;
+            std::cout << "Median baseline: SAH cost " << median_cost
+                      << ", this tree costs " << cost / median_cost
+                      << " of it" << std::endl;
+        }
+        // Leaf order, before the streams are split from it
+        if (options.triangle_streams != TRIANGLES_INDEXED) {
+            std::vector<TriangleVertexIds>().swap(vertex_ids);
+        }
+        reference_indices =
+            order_triangles(triangle_arena, triangles, vertex_ids);
+        if (!reference_indices.empty()) {
+            std::cout << triangles.size() << " references to "
+                      << triangle_arena.size() << " triangles" << std::endl;
+        }
+        std::vector<TriangleForGLSL *> uploaded =
+            triangle_pointers(triangle_arena);
+        if (options.triangle_streams == TRIANGLES_SPLIT) {
+            split_triangles(uploaded, materials, triangle_geometry,
+                            triangle_attributes);
+        } else if (options.triangle_streams == TRIANGLES_PRECOMPUTED) {
+            precompute_triangles(uploaded, materials, triangle_edges,
+                                 triangle_attributes);
+        } else if (options.triangle_streams == TRIANGLES_INDEXED) {
+            index_triangles(uploaded, vertex_ids, materials,
+                            welded_vertices, triangle_indices,
+                            triangle_attributes);
+            std::vector<TriangleVertexIds>().swap(vertex_ids);
+            std::cout << "Welded " << 3 * uploaded.size()
+                      << " triangle vertices into " << welded_vertices.size()
+                      << std::endl;
+        }
+        std::cout << materials.size() << " materials in "
+                  << file_stats.size() << " files" << std::endl;
+        if (options.bvh_width == 4) {
+            wide4 = collapse_bvh<4>(boxes, aabb->root_id);
+        } else if (options.bvh_width == 8) {
+            wide8 = collapse_bvh<8>(boxes, aabb->root_id);
+        }
+        if (options.quantized) {
+            quantized = quantize_bvh(boxes, aabb->root_id);
+        }
+        if (options.stackless) {
+            links = stackless_links(boxes, aabb->root_id);
+        }
+    }
+    if (!options.stats_path.empty()) {
+        SceneStats stats;
+        stats.builder = builder_name(options.builder);
+        if (instanced) {
+            stats.bvh = bvh_stats(scene.tlas, scene.tlas_root_id, build_params);
+            for (const auto &mesh : scene.meshes) {
+                stats.meshes.push_back(
+                    bvh_stats(mesh.boxes, mesh.root_id, build_params));
+            }
+        } else if (dynamic) {
+            stats.bvh = bvh_stats(dynamic_bvh.boxes, dynamic_bvh.root_id,
+                                  build_params);
+        } else {
+            stats.bvh = bvh_stats(boxes, aabb->root_id, build_params);
+            stats.bvh.node_bytes += wide4.size() * sizeof(WideBox<4>) +
+                                    wide8.size() * sizeof(WideBox<8>) +
+                                    quantized.size() * sizeof(QuantizedBox) +
+                                    links.size() * sizeof(StacklessLink);
+        }
+        stats.triangles = triangle_count;
+        stats.triangle_bytes = triangle_count * sizeof(TriangleForGLSL);
+        if (!instanced && !dynamic) {
+            stats.triangle_bytes =
+                triangle_arena.size() * sizeof(TriangleForGLSL);
+        }
+        if (!triangle_attributes.empty()) {
+            stats.triangle_bytes =
+                triangle_geometry.size() * sizeof(TriangleGeometry) +
+                triangle_edges.size() * sizeof(TriangleEdges) +
+                welded_vertices.size() * sizeof(PaddedVec3ForGLSL) +
+                triangle_indices.size() * sizeof(TriangleIndices) +
+                triangle_attributes.size() * sizeof(TriangleAttributes);
+        }
+        if (!instanced && !dynamic) {
+            stats.triangle_bytes += materials.size() * sizeof(MaterialForGLSL);
+        }
+        stats.triangle_bytes += reference_indices.size() * sizeof(uint32_t);
+        stats.textures = textures.size();
+        for (const auto &texture : textures) {
+            stats.texture_bytes += texture.image.size();
+        }
+        stats.texture_bytes += environment_texture.image.size();
+        stats.files = file_stats;
+        if (options.stats_path == "-") {
+            std::ostream stdout_stream(stdout_buffer);
+            write_stats_json(stdout_stream, stats);
+        } else {
+            std::ofstream stats_file(options.stats_path);
+            if (stats_file) {
+                write_stats_json(stats_file, stats);
+            }
+            if (!stats_file) {
+                std::cerr << "Could not write the stats to "
+                          << options.stats_path << std::endl;
+                return 1;
+            }
+        }
+    }
 #ifdef DEBUG_PRINT_EXTENDED
-    print_box(boxes, aabb->root_id, 0, triangles);
+    if (!instanced) {
+        print_box(boxes, aabb->root_id, 0, triangles);
+    }
 #endif
 
     // glfw: initialize and configure
@@ -267,14 +564,8 @@ int main(int argc, char *argv[]) {
             temp.y = 1;
             ratios.push_back(temp);
         }
-        GLuint tex_ratios;
-        glGenBuffers(1, &tex_ratios);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, tex_ratios);
-        glBufferData(GL_SHADER_STORAGE_BUFFER,
-                     ratios.size() * sizeof(PaddedVec3ForGLSL), ratios.data(),
-                     GL_DYNAMIC_COPY);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, tex_ratios);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        create_ssbo(SSBO_TEXTURE_RATIOS, ratios.data(),
+                    ratios.size() * sizeof(PaddedVec3ForGLSL));
         if(sky_path!="") {
         glGenTextures(1, &texture_env);
         glBindTexture(GL_TEXTURE_2D, texture_env);
@@ -333,31 +624,70 @@ int main(int argc, char *argv[]) {
     int frame = 0;
     // SSBO for vectors
     // triangles
-    // copy triangles to array
-    TriangleForGLSL *triangle_array = new TriangleForGLSL[triangles.size()];
-    for (size_t i = 0; i < triangles.size(); ++i) {
-        triangle_array[i] = *triangles[i];
-    }
-    for (auto t : triangles) {
-        delete t;
+    // the flat arena is in leaf order already, the dynamic BVH keeps copies
+    // of its own
+    if (dynamic) {
+        triangles.clear();
+        std::vector<TriangleForGLSL>().swap(triangle_arena);
     }
 #ifdef DEBUG_PRINT
     auto start_ssbo = std::chrono::high_resolution_clock::now();
 #endif
-    GLuint ssbo_triangles;
-    glGenBuffers(1, &ssbo_triangles);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_triangles);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-                 triangles.size() * sizeof(TriangleForGLSL), triangle_array,
-                 GL_DYNAMIC_COPY);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, ssbo_triangles);
-    GLuint ssbo_boxes;
-    glGenBuffers(1, &ssbo_boxes);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_boxes);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, boxes.size() * sizeof(Box),
-                 boxes.data(), GL_DYNAMIC_COPY);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, ssbo_boxes);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    DynamicBuffers dynamic_buffers{};
+    FlatBuffers flat_buffers{};
+    if (instanced) {
+        create_scene_ssbos(scene);
+    } else if (dynamic) {
+        dynamic_buffers = create_dynamic_ssbos(dynamic_bvh);
+    } else {
+        if (options.triangle_streams == TRIANGLES_SPLIT) {
+            flat_buffers.geometry = create_ssbo(
+                SSBO_TRIANGLE_GEOMETRY, triangle_geometry.data(),
+                triangle_geometry.size() * sizeof(TriangleGeometry));
+        } else if (options.triangle_streams == TRIANGLES_PRECOMPUTED) {
+            flat_buffers.edges =
+                create_ssbo(SSBO_TRIANGLE_EDGES, triangle_edges.data(),
+                            triangle_edges.size() * sizeof(TriangleEdges));
+        } else if (options.triangle_streams == TRIANGLES_INDEXED) {
+            flat_buffers.welded_vertices = create_ssbo(
+                SSBO_WELDED_VERTICES, welded_vertices.data(),
+                welded_vertices.size() * sizeof(PaddedVec3ForGLSL));
+            create_ssbo(SSBO_TRIANGLE_INDICES, triangle_indices.data(),
+                        triangle_indices.size() * sizeof(TriangleIndices));
+        }
+        if (options.triangle_streams != TRIANGLES_FULL) {
+            create_ssbo(SSBO_TRIANGLE_ATTRIBUTES, triangle_attributes.data(),
+                        triangle_attributes.size() *
+                            sizeof(TriangleAttributes));
+        } else {
+            flat_buffers.triangles =
+                create_ssbo(SSBO_TRIANGLES, triangle_arena.data(),
+                            triangle_arena.size() * sizeof(TriangleForGLSL));
+        }
+        create_ssbo(SSBO_MATERIALS, materials.data(),
+                    materials.size() * sizeof(MaterialForGLSL));
+        flat_buffers.boxes =
+            create_ssbo(SSBO_BOXES, boxes.data(), boxes.size() * sizeof(Box));
+        if (!reference_indices.empty()) {
+            create_ssbo(SSBO_REFERENCE_INDICES, reference_indices.data(),
+                        reference_indices.size() * sizeof(uint32_t));
+        }
+        if (!wide4.empty()) {
+            create_ssbo(SSBO_WIDE_BOXES, wide4.data(),
+                        wide4.size() * sizeof(WideBox<4>));
+        } else if (!wide8.empty()) {
+            create_ssbo(SSBO_WIDE_BOXES, wide8.data(),
+                        wide8.size() * sizeof(WideBox<8>));
+        }
+        if (!quantized.empty()) {
+            create_ssbo(SSBO_QUANTIZED_BOXES, quantized.data(),
+                        quantized.size() * sizeof(QuantizedBox));
+        }
+        if (!links.empty()) {
+            create_ssbo(SSBO_STACKLESS_LINKS, links.data(),
+                        links.size() * sizeof(StacklessLink));
+        }
+    }
 #ifdef DEBUG_PRINT
     auto end_ssbo = std::chrono::high_resolution_clock::now();
     std::cout << "SSBO creation took "
@@ -366,10 +696,78 @@ int main(int argc, char *argv[]) {
                      .count()
               << "ms" << std::endl;
 #endif
+    // animate=: the triangles at rest in tree order, waved from there every
+    // frame and refit
+    std::vector<TriangleForGLSL> rest_triangles;
+    RefitPlan refit_plan;
+    float wave_width = 0;
+    if (options.animate > 0) {
+        rest_triangles = triangle_arena;
+        refit_plan = make_refit_plan(boxes, aabb->root_id);
+        Bounds bounds = box_bounds(boxes[aabb->root_id]);
+        wave_width = std::max(bounds.max.x - bounds.min.x, 1e-6f);
+    }
+    bool insert_was_down = false;
+    bool remove_was_down = false;
+    bool view_was_down = false;
     while (!glfwWindowShouldClose(window)) {
         // input
         // -----
         process_input(window);
+        if (key_pressed(window, GLFW_KEY_V, view_was_down) &&
+            !options.views_path.empty()) {
+            glm::vec3 position = get_position();
+            glm::vec2 rotation = get_rotation();
+            CameraView view{PaddedVec3ForGLSL{position.x, position.y,
+                                              position.z, 0},
+                            rotation.x, rotation.y};
+            if (append_view(options.views_path, view)) {
+                std::cout << "View saved to " << options.views_path
+                          << std::endl;
+            }
+        }
+        if (dynamic) {
+            bool changed = false;
+            if (key_pressed(window, GLFW_KEY_I, insert_was_down) &&
+                next_stream < options.stream_paths.size()) {
+                int batch =
+                    stream_model(dynamic_bvh, options.stream_paths[next_stream],
+                                 options.builder, build_params, materials,
+                                 pool);
+                if (batch == -1) {
+                    // Dropped, so O still removes the file I loaded last
+                    options.stream_paths.erase(options.stream_paths.begin() +
+                                               next_stream);
+                } else {
+                    streamed_batches.push_back(batch);
+                    next_stream++;
+                    changed = true;
+                }
+            }
+            if (key_pressed(window, GLFW_KEY_O, remove_was_down) &&
+                !streamed_batches.empty()) {
+                remove_batch(dynamic_bvh, streamed_batches.back());
+                streamed_batches.pop_back();
+                next_stream--;
+                changed = true;
+            }
+            if (changed) {
+                upload_dynamic(dynamic_buffers, dynamic_bvh);
+                aabb->root_id = dynamic_bvh.root_id;
+                triangle_count = dynamic_bvh.triangles.size();
+            }
+        }
+
+        if (options.animate > 0) {
+            std::vector<PaddedVec3ForGLSL> positions = wave_positions(
+                rest_triangles, options.animate * wave_width, wave_width / 8,
+                glfwGetTime());
+            RefitResult result =
+                refit_aabb(boxes, triangles, positions, refit_plan, pool);
+            upload_refit(flat_buffers, options.triangle_streams, triangles,
+                         materials, triangle_indices, welded_vertices, boxes,
+                         result);
+        }
 
         // Compute the MVP matrix from keyboard and mouse input
         update_movement(window, mode);
@@ -415,7 +813,10 @@ int main(int argc, char *argv[]) {
         glUniform1i(frame_location, frame++);
         int triangle_count_location =
             glGetUniformLocation(shader_program, "triangle_count");
-        glUniform1i(triangle_count_location, triangles.size());
+        glUniform1i(triangle_count_location, triangle_count);
+        int instance_count_location =
+            glGetUniformLocation(shader_program, "instance_count");
+        glUniform1i(instance_count_location, scene.instances.size());
         int positionLocation = glGetUniformLocation(shader_program, "position");
         glm::vec3 position = get_position();
         glUniform3f(positionLocation, position.x, position.y, position.z);
@@ -426,6 +827,26 @@ int main(int argc, char *argv[]) {
         // AABB
         int root_id_location = glGetUniformLocation(shader_program, "root_id");
         glUniform1i(root_id_location, aabb->root_id);
+        int bvh_width_location =
+            glGetUniformLocation(shader_program, "bvh_width");
+        glUniform1i(bvh_width_location,
+                    instanced || dynamic ? 2 : options.bvh_width);
+        int quantized_location =
+            glGetUniformLocation(shader_program, "quantized_nodes");
+        glUniform1i(quantized_location,
+                    !instanced && !dynamic && options.quantized);
+        int stackless_location =
+            glGetUniformLocation(shader_program, "stackless");
+        glUniform1i(stackless_location,
+                    !instanced && !dynamic && options.stackless);
+        int reference_indices_location =
+            glGetUniformLocation(shader_program, "reference_indices");
+        glUniform1i(reference_indices_location, !reference_indices.empty());
+        int triangle_streams_location =
+            glGetUniformLocation(shader_program, "triangle_streams");
+        glUniform1i(triangle_streams_location,
+                    instanced || dynamic ? TRIANGLES_FULL
+                                         : options.triangle_streams);
 
         int render_mode_location = glGetUniformLocation(shader_program, "fast_render");
         glUniform1i(render_mode_location, get_render_mode());
@@ -452,6 +873,45 @@ void process_input(GLFWwindow *window) {
         glfwSetWindowShouldClose(window, true);
 }
 
+// True once per press of `key`
+bool key_pressed(GLFWwindow *window, int key, bool &was_down) {
+    bool down = glfwGetKey(window, key) == GLFW_PRESS;
+    bool pressed = down && !was_down;
+    was_down = down;
+    return pressed;
+}
+
+// Loads a model and inserts it into the running scene, returns its batch
+int stream_model(DynamicBVH &bvh, const std::string &path, int builder,
+                 const BuildParams &params,
+                 std::vector<MaterialForGLSL> &materials, ThreadPool &pool) {
+    auto start = std::chrono::high_resolution_clock::now();
+    OurNode model = load_model(path);
+    // The texture array is allocated once at startup and cannot take more
+    if (!model.images.empty()) {
+        std::cerr << "Not inserting " << path << ": streamed models cannot "
+                  << "add textures" << std::endl;
+        return -1;
+    }
+    std::vector<TriangleForGLSL> loaded;
+    node_to_triangles(model, loaded);
+    // After the materials of the startup files, as theirs are
+    uint32_t material_offset = materials.size();
+    append_materials(model.materials, materials);
+    for (auto &triangle : loaded) {
+        triangle.material_id += material_offset;
+    }
+    std::vector<TriangleForGLSL *> triangles = triangle_pointers(loaded);
+    int batch = insert_batch(bvh, triangles, builder, params, pool);
+    std::cout << "Inserted " << path << ": " << triangles.size()
+              << " triangles in "
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::high_resolution_clock::now() - start)
+                     .count()
+              << "ms" << std::endl;
+    return batch;
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback
 // function executes
 // ---------------------------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+#include "./material_table.hpp"
+#include "./load_model.hpp"
+#include "./tiny_gltf.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+uint32_t primitive_material_id(int material, bool textured,
+                               size_t material_count) {
+    if (material < 0 || static_cast<size_t>(material) >= material_count) {
+        return static_cast<uint32_t>(2 * material_count);
+    }
+    return static_cast<uint32_t>(textured ? material
+                                          : material_count + material);
+}
+
+float material_alpha_cutoff(const tinygltf::Material &material) {
+    if (material.alphaMode != "MASK") {
+        return 0;
+    }
+    return static_cast<float>(material.alphaCutoff);
+}
+
+// What the loader gives the triangles of a primitive without a material
+MaterialForGLSL default_material() {
+    MaterialForGLSL material{};
+    material.texture_id = std::numeric_limits<uint32_t>::max();
+    material.metallic_roughness_texture_id =
+        std::numeric_limits<uint32_t>::max();
+    material.metallic_factor = 0.5f;
+    material.roughness_factor = 0.5f;
+    material.alpha_cutoff = 0;
+    material.double_sided = 1;
+    material.base_color_factor = Vec4ForGLSL{1.0f, 1.0f, 1.0f, 1.0f};
+    return material;
+}
+
+MaterialForGLSL gltf_material(const tinygltf::Material &gltf_material,
+                              bool textured) {
+    const tinygltf::PbrMetallicRoughness &pbr =
+        gltf_material.pbrMetallicRoughness;
+    MaterialForGLSL material = default_material();
+    if (textured) {
+        material.texture_id = pbr.baseColorTexture.index;
+        material.metallic_roughness_texture_id =
+            pbr.metallicRoughnessTexture.index;
+        material.base_color_factor = Vec4ForGLSL{
+            static_cast<float>(pbr.baseColorFactor[0]),
+            static_cast<float>(pbr.baseColorFactor[1]),
+            static_cast<float>(pbr.baseColorFactor[2]),
+            static_cast<float>(pbr.baseColorFactor[3])};
+    }
+    material.metallic_factor = static_cast<float>(pbr.metallicFactor);
+    material.roughness_factor = static_cast<float>(pbr.roughnessFactor);
+    material.alpha_cutoff = material_alpha_cutoff(gltf_material);
+    material.double_sided = gltf_material.doubleSided;
+    material.emissive_factor = PaddedVec3ForGLSL{
+        static_cast<float>(gltf_material.emissiveFactor[0]),
+        static_cast<float>(gltf_material.emissiveFactor[1]),
+        static_cast<float>(gltf_material.emissiveFactor[2]), 0};
+    return material;
+}
+
+void append_materials(const std::vector<tinygltf::Material> &gltf_materials,
+                      std::vector<MaterialForGLSL> &materials) {
+    materials.reserve(materials.size() + 2 * gltf_materials.size() + 1);
+    for (bool textured : {true, false}) {
+        for (const auto &material : gltf_materials) {
+            materials.push_back(gltf_material(material, textured));
+        }
+    }
+    materials.push_back(default_material());
+}
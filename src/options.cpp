@@ -0,0 +1,302 @@
+#include "./options.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+bool starts_with(const std::string &arg, const std::string &prefix) {
+    return arg.rfind(prefix, 0) == 0;
+}
+
+void print_usage(const char *program) {
+    std::cout << "Usage: " << program
+              << " <shader file> [<gltf_file>...] [<glb_file>...] ... "
+                 "[options]\n"
+                 "Options:\n"
+                 "  sky=<file>\n"
+                 "  mode=<mouse|arrows>\n"
+                 "  builder=<median|sah|sbvh|lbvh|ploc>\n"
+                 "  morton=<30|63>        Morton code bits of lbvh\n"
+                 "  leaf=<triangles>      largest leaf, 8 by default\n"
+                 "  traversal_cost=<cost> SAH cost of a node step\n"
+                 "  intersection_cost=<cost>\n"
+                 "  clip=<budget>         split large triangles first\n"
+                 "  clip_ratio=<ratio>    over the median area is large\n"
+                 "  scene=<flat|instanced|dynamic>\n"
+                 "  stream=<file>         model inserted at runtime\n"
+                 "  width=<2|4|8>         also upload a wide BVH\n"
+                 "  nodes=<full|quantized>\n"
+                 "  traversal=<stack|stackless>\n"
+                 "  triangles=<full|split|indexed|precomputed>\n"
+                 "  layout=<post|dfs|veb> order of the boxes in memory\n"
+                 "  views=<file>          build for the views in the file\n"
+                 "  treelets=<passes>     restructure the tree after building\n"
+                 "  animate=<amplitude>   wave the scene, refit every frame\n"
+                 "  threads=<count>\n"
+                 "  profile=<file|none>   tuned options, read first\n"
+                 "  cache=<dir|none>      where built trees are kept\n"
+                 "  --stats, stats=<file> print or write scene statistics\n"
+                 "  bench=<threads|arena|builders|refit|wide|quantized|"
+                 "layout|\n"
+                 "         autotune|treelets|dynamic|stackless|views|\n"
+                 "         triangles|intersect>\n"
+              << std::endl;
+}
+
+bool parse_option(const std::string &arg, Options &options) {
+    if (starts_with(arg, "mode=")) {
+        if (arg.substr(5) == "arrows") {
+            options.mode = MODE_ARROWS;
+        }
+    } else if (starts_with(arg, "sky=")) {
+        options.sky_path = arg.substr(4);
+    } else if (starts_with(arg, "builder=")) {
+        options.builder = find_builder(arg.substr(8));
+        if (options.builder == -1) {
+            std::cerr << "Unknown builder: " << arg.substr(8) << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "morton=")) {
+        options.build_params.morton_bits = std::atoi(arg.substr(7).c_str());
+        if (options.build_params.morton_bits != 30 &&
+            options.build_params.morton_bits != 63) {
+            std::cerr << "Morton codes have 30 or 63 bits" << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "leaf=")) {
+        options.build_params.leaf_size = std::atoi(arg.substr(5).c_str());
+        if (options.build_params.leaf_size < 1) {
+            std::cerr << "Invalid leaf size: " << arg.substr(5) << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "traversal_cost=")) {
+        options.build_params.traversal_cost =
+            std::atof(arg.substr(15).c_str());
+        if (!(options.build_params.traversal_cost > 0)) {
+            std::cerr << "Invalid traversal cost: " << arg.substr(15)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "intersection_cost=")) {
+        options.build_params.intersection_cost =
+            std::atof(arg.substr(18).c_str());
+        if (!(options.build_params.intersection_cost > 0)) {
+            std::cerr << "Invalid intersection cost: " << arg.substr(18)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "clip=")) {
+        options.build_params.clip_budget = std::atof(arg.substr(5).c_str());
+        if (!(options.build_params.clip_budget >= 0)) {
+            std::cerr << "Invalid clip budget: " << arg.substr(5)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "clip_ratio=")) {
+        options.build_params.clip_ratio = std::atof(arg.substr(11).c_str());
+        if (!(options.build_params.clip_ratio > 0)) {
+            std::cerr << "Invalid clip ratio: " << arg.substr(11)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "views=")) {
+        options.views_path = arg.substr(6);
+    } else if (starts_with(arg, "scene=")) {
+        if (arg.substr(6) == "instanced") {
+            options.scene = SCENE_INSTANCED;
+        } else if (arg.substr(6) == "dynamic") {
+            options.scene = SCENE_DYNAMIC;
+        } else if (arg.substr(6) != "flat") {
+            std::cerr << "Unknown scene layout: " << arg.substr(6)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "stream=")) {
+        options.stream_paths.emplace_back(arg.substr(7));
+    } else if (starts_with(arg, "width=")) {
+        options.bvh_width = std::atoi(arg.substr(6).c_str());
+        if (options.bvh_width != 2 && options.bvh_width != 4 &&
+            options.bvh_width != 8) {
+            std::cerr << "BVH width is 2, 4 or 8" << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "nodes=")) {
+        options.quantized = arg.substr(6) == "quantized";
+        if (!options.quantized && arg.substr(6) != "full") {
+            std::cerr << "Unknown node encoding: " << arg.substr(6)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "traversal=")) {
+        options.stackless = arg.substr(10) == "stackless";
+        if (!options.stackless && arg.substr(10) != "stack") {
+            std::cerr << "Unknown traversal: " << arg.substr(10)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "triangles=")) {
+        if (arg.substr(10) == "full") {
+            options.triangle_streams = TRIANGLES_FULL;
+        } else if (arg.substr(10) == "split") {
+            options.triangle_streams = TRIANGLES_SPLIT;
+        } else if (arg.substr(10) == "indexed") {
+            options.triangle_streams = TRIANGLES_INDEXED;
+        } else if (arg.substr(10) == "precomputed") {
+            options.triangle_streams = TRIANGLES_PRECOMPUTED;
+        } else {
+            std::cerr << "Unknown triangle layout: " << arg.substr(10)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "layout=")) {
+        options.layout = find_layout(arg.substr(7));
+        if (options.layout == -1) {
+            std::cerr << "Unknown layout: " << arg.substr(7) << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "treelets=")) {
+        options.treelet_passes = std::atoi(arg.substr(9).c_str());
+        if (options.treelet_passes < 0) {
+            std::cerr << "Invalid treelet pass count: " << arg.substr(9)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "threads=")) {
+        options.threads = std::atoi(arg.substr(8).c_str());
+        if (options.threads < 1) {
+            std::cerr << "Invalid thread count: " << arg.substr(8)
+                      << std::endl;
+            return false;
+        }
+    } else if (starts_with(arg, "bench=")) {
+        options.bench = arg.substr(6);
+    } else if (starts_with(arg, "cache=")) {
+        options.cache_dir = arg.substr(6);
+    } else if (starts_with(arg, "animate=")) {
+        options.animate = std::atof(arg.substr(8).c_str());
+        if (options.animate < 0) {
+            std::cerr << "Invalid animation amplitude: " << arg.substr(8)
+                      << std::endl;
+            return false;
+        }
+    } else if (arg == "--stats") {
+        options.stats_path = "-";
+    } else if (starts_with(arg, "stats=")) {
+        options.stats_path = arg.substr(6);
+    } else if (starts_with(arg, "profile=")) {
+        options.profile_path = arg.substr(8);
+    } else {
+        options.model_paths.emplace_back(arg);
+    }
+    return true;
+}
+
+bool load_profile(const std::string &path, Options &options) {
+    std::ifstream file(path);
+    if (!file) {
+        return true;
+    }
+    std::string line;
+    std::vector<std::string> entries;
+    int builder = options.builder;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (starts_with(line, "builder=")) {
+            builder = find_builder(line.substr(8));
+            if (builder == -1) {
+                std::cerr << "Unknown builder in " << path << ": " << line
+                          << std::endl;
+                return false;
+            }
+            continue;
+        }
+        // Only tuned options, a stray line must not load a model
+        if (!starts_with(line, "leaf=") &&
+            !starts_with(line, "traversal_cost=") &&
+            !starts_with(line, "intersection_cost=") &&
+            !starts_with(line, "width=")) {
+            std::cerr << "Unknown profile entry in " << path << ": " << line
+                      << std::endl;
+            return false;
+        }
+        entries.push_back(line);
+    }
+    // Leaf size and costs tuned for one builder are no good for another
+    if (builder != options.builder) {
+        std::cerr << "Ignoring profile " << path << ", it was tuned for "
+                  << "builder=" << builder_name(builder) << std::endl;
+        return true;
+    }
+    for (const std::string &entry : entries) {
+        if (!parse_option(entry, options)) {
+            return false;
+        }
+    }
+    std::cout << "Loaded profile " << path << std::endl;
+    return true;
+}
+
+bool parse_options(int argc, char *argv[], Options &options) {
+    if (argc < 2) {
+        return false;
+    }
+    options.shader_path = argv[1];
+    // The profile and the builder it must match are picked first so every
+    // other argument overrides the profile
+    for (int i = 2; i < argc; ++i) {
+        if (starts_with(argv[i], "profile=")) {
+            options.profile_path = std::string(argv[i]).substr(8);
+        } else if (starts_with(argv[i], "builder=") &&
+                   find_builder(std::string(argv[i]).substr(8)) != -1) {
+            options.builder = find_builder(std::string(argv[i]).substr(8));
+        }
+    }
+    if (!options.profile_path.empty() && options.profile_path != "none" &&
+        !load_profile(options.profile_path, options)) {
+        return false;
+    }
+    bool width_given = false;
+    for (int i = 2; i < argc; ++i) {
+        if (!parse_option(argv[i], options)) {
+            return false;
+        }
+        width_given = width_given || starts_with(argv[i], "width=");
+    }
+    // A refit keeps every triangle in its leaves and moves only the binary
+    // boxes, so a width from the profile yields to animate=
+    if (options.animate > 0 && !width_given) {
+        options.bvh_width = 2;
+    }
+    if (options.animate > 0 &&
+        (options.scene != SCENE_FLAT || options.builder == BUILDER_SBVH ||
+         options.build_params.clip_budget > 0 || options.bvh_width != 2 ||
+         options.quantized)) {
+        std::cerr << "animate= needs scene=flat, a builder other than sbvh, "
+                     "no clip=, width=2 and nodes=full"
+                  << std::endl;
+        return false;
+    }
+    // Benchmarks run on the flat scene whatever scene= says
+    if (options.treelet_passes > 0 && options.scene != SCENE_FLAT &&
+        options.bench.empty()) {
+        std::cerr << "treelets= needs scene=flat" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool stats_to_stdout(int argc, char *argv[]) {
+    bool to_stdout = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stats") {
+            to_stdout = true;
+        } else if (starts_with(arg, "stats=")) {
+            to_stdout = arg.substr(6) == "-";
+        }
+    }
+    return to_stdout;
+}
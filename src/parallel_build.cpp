@@ -0,0 +1,64 @@
+#include "./parallel_build.hpp"
+#include "./aabb.hpp"
+#include "./arena_build.hpp"
+#include "./thread_pool.hpp"
+#include <algorithm>
+#include <vector>
+
+// Subtrees smaller than this are built by the task that reaches them,
+// without recursion
+const int PARALLEL_BUILD_GRAIN = 4096;
+
+// Writes the subtree over [start, end) into the `count_boxes` slots starting
+// at `first_slot`, in the post-order `triangles_to_box` emits: left subtree,
+// right subtree, then the node itself.
+void fill_box_slots(std::vector<Box> &boxes,
+                    std::vector<TriangleForGLSL *> &triangles, int start,
+                    int end, int coord, int first_slot,
+                    const BuildParams &params, ThreadPool &pool) {
+    int span = end - start;
+    if (span < PARALLEL_BUILD_GRAIN || pool.size() == 1) {
+        fill_median_slots(boxes, triangles, start, end, coord, first_slot,
+                          params.leaf_size);
+        return;
+    }
+
+    int mid = start + span / 2;
+    std::nth_element(
+        triangles.begin() + start, triangles.begin() + mid,
+        triangles.begin() + end,
+        [coord](const TriangleForGLSL *a, const TriangleForGLSL *b) {
+            return get_coord(coord, a->min) < get_coord(coord, b->min);
+        });
+
+    int left_count = count_boxes(mid - start, params.leaf_size);
+    int right_count = count_boxes(end - mid, params.leaf_size);
+    int right_slot = first_slot + left_count;
+    int next = get_next_coord(coord);
+    TaskGroup group;
+    pool.run(group, [&]() {
+        fill_box_slots(boxes, triangles, start, mid, next, first_slot, params,
+                       pool);
+    });
+    fill_box_slots(boxes, triangles, mid, end, next, right_slot, params,
+                   pool);
+    pool.wait(group);
+
+    int left = right_slot - 1;
+    int right = right_slot + right_count - 1;
+    Bounds bounds =
+        merge_bounds(box_bounds(boxes[left]), box_bounds(boxes[right]));
+    boxes[right + 1] = Box(bounds.min, bounds.max, left, right, start, end);
+}
+
+AABB *triangles_to_aabb_parallel(std::vector<Box> &boxes,
+                                 std::vector<TriangleForGLSL *> &triangles,
+                                 const BuildParams &params, ThreadPool &pool) {
+    int first_slot = boxes.size();
+    int count = count_boxes(triangles.size(), params.leaf_size);
+    PaddedVec3ForGLSL zero{0, 0, 0, 0};
+    boxes.resize(first_slot + count, Box(zero, zero, -1, -1, 0, 0));
+    fill_box_slots(boxes, triangles, 0, triangles.size(), 0, first_slot,
+                   params, pool);
+    return new AABB{first_slot + count - 1};
+}
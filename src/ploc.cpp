@@ -0,0 +1,79 @@
+#include "./ploc.hpp"
+#include "./aabb.hpp"
+#include "./lbvh.hpp"
+#include "./thread_pool.hpp"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+const int PLOC_GRAIN = 1024;
+
+AABB *triangles_to_aabb_ploc(std::vector<Box> &boxes,
+                             std::vector<TriangleForGLSL *> &triangles,
+                             const BuildParams &params, ThreadPool &pool) {
+    int count = triangles.size();
+    sort_by_morton(triangles, params.morton_bits, pool);
+
+    // One leaf per triangle, merged clusters are appended after them
+    std::vector<Box> nodes;
+    nodes.reserve(std::max(1, 2 * count - 1));
+    for (int i = 0; i < count; ++i) {
+        Bounds bounds = triangle_bounds(*triangles[i]);
+        nodes.emplace_back(bounds.min, bounds.max, -1, -1, i, i + 1);
+    }
+    if (count == 0) {
+        Bounds bounds = empty_bounds();
+        nodes.emplace_back(bounds.min, bounds.max, -1, -1, 0, 0);
+    }
+
+    std::vector<int> clusters(count);
+    for (int i = 0; i < count; ++i) {
+        clusters[i] = i;
+    }
+    std::vector<int> nearest(count);
+    std::vector<int> next_clusters;
+    int radius = std::max(1, params.ploc_radius);
+    while (clusters.size() > 1) {
+        int cluster_count = clusters.size();
+        pool.parallel_for(0, cluster_count, PLOC_GRAIN, [&](int i) {
+            Bounds bounds = box_bounds(nodes[clusters[i]]);
+            float best_area = std::numeric_limits<float>::max();
+            int best = -1;
+            int last = std::min(cluster_count - 1, i + radius);
+            for (int j = std::max(0, i - radius); j <= last; ++j) {
+                if (j == i) {
+                    continue;
+                }
+                float area = surface_area(
+                    merge_bounds(bounds, box_bounds(nodes[clusters[j]])));
+                // Strict comparison keeps the lowest index on ties, so the
+                // result does not depend on the thread count
+                if (area < best_area) {
+                    best_area = area;
+                    best = j;
+                }
+            }
+            nearest[i] = best;
+        });
+
+        // Merge mutual nearest neighbours in place of the left one
+        next_clusters.clear();
+        for (int i = 0; i < cluster_count; ++i) {
+            int j = nearest[i];
+            if (nearest[j] != i) {
+                next_clusters.push_back(clusters[i]);
+            } else if (i < j) {
+                const Box &left = nodes[clusters[i]];
+                const Box &right = nodes[clusters[j]];
+                Bounds bounds =
+                    merge_bounds(box_bounds(left), box_bounds(right));
+                nodes.emplace_back(bounds.min, bounds.max, clusters[i],
+                                   clusters[j], 0, 0);
+                next_clusters.push_back(nodes.size() - 1);
+            }
+        }
+        clusters.swap(next_clusters);
+    }
+
+    return linearize_tree(boxes, triangles, nodes, nodes.size() - 1, params);
+}
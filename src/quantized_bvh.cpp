@@ -0,0 +1,163 @@
+#include "./quantized_bvh.hpp"
+#include "./aabb.hpp"
+#include "./ray.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+const int QUANTIZED_EXPONENT_BIAS = 127;
+
+// Scale of one step, the float with biased exponent `exponent`
+float quantized_scale(uint32_t exponent) {
+    uint32_t bits = exponent << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+float decode_coord(float origin, uint32_t exponent, uint8_t value) {
+    return origin + static_cast<float>(value) * quantized_scale(exponent);
+}
+
+// Smallest biased exponent whose 255 steps reach `high` from `low`
+uint32_t quantized_exponent(float low, float high) {
+    int exponent = 1;
+    if (high > low) {
+        std::frexp((high - low) / 255.0f, &exponent);
+        exponent = std::max(1, exponent + QUANTIZED_EXPONENT_BIAS - 1);
+    }
+    while (exponent < 254 && decode_coord(low, exponent, 255) < high) {
+        exponent++;
+    }
+    return exponent;
+}
+
+// Largest step at or below `value`, so the decoded minimum never grows
+uint8_t quantize_min(float origin, uint32_t exponent, float value) {
+    int step = static_cast<int>(
+        std::floor((value - origin) / quantized_scale(exponent)));
+    step = std::max(0, std::min(255, step));
+    while (step > 0 && decode_coord(origin, exponent, step) > value) {
+        step--;
+    }
+    return step;
+}
+
+// Smallest step at or above `value`, so the decoded maximum never shrinks
+uint8_t quantize_max(float origin, uint32_t exponent, float value) {
+    int step = static_cast<int>(
+        std::ceil((value - origin) / quantized_scale(exponent)));
+    step = std::max(0, std::min(255, step));
+    while (step < 255 && decode_coord(origin, exponent, step) < value) {
+        step++;
+    }
+    return step;
+}
+
+void encode_node(std::vector<QuantizedBox> &nodes,
+                 const std::vector<Box> &boxes, int box_id, int node_id) {
+    const Box &box = boxes[box_id];
+    QuantizedBox node{};
+    if (box.left_id == -1) {
+        uint32_t count = box.end - box.start;
+        std::memcpy(node.quantized, &count, sizeof(count));
+        node.index = box.start;
+        nodes[node_id] = node;
+        return;
+    }
+
+    uint32_t exponents[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        node.origin[axis] = get_coord(axis, box.min);
+        exponents[axis] = quantized_exponent(get_coord(axis, box.min),
+                                             get_coord(axis, box.max));
+    }
+    node.exponents = exponents[0] | exponents[1] << 8 | exponents[2] << 16;
+    int children[2] = {box.left_id, box.right_id};
+    for (int child = 0; child < 2; ++child) {
+        const Box &bounds = boxes[children[child]];
+        for (int axis = 0; axis < 3; ++axis) {
+            node.quantized[6 * child + axis] =
+                quantize_min(node.origin[axis], exponents[axis],
+                             get_coord(axis, bounds.min));
+            node.quantized[6 * child + 3 + axis] =
+                quantize_max(node.origin[axis], exponents[axis],
+                             get_coord(axis, bounds.max));
+        }
+    }
+    node.index = nodes.size();
+    nodes[node_id] = node;
+    nodes.resize(nodes.size() + 2);
+    encode_node(nodes, boxes, box.left_id, node.index);
+    encode_node(nodes, boxes, box.right_id, node.index + 1);
+}
+
+std::vector<QuantizedBox> quantize_bvh(const std::vector<Box> &boxes,
+                                       int root_id) {
+    std::vector<QuantizedBox> nodes(1);
+    nodes.reserve(boxes.size());
+    encode_node(nodes, boxes, root_id, 0);
+    return nodes;
+}
+
+Bounds quantized_child_bounds(const QuantizedBox &node, int child) {
+    Bounds bounds{};
+    for (int axis = 0; axis < 3; ++axis) {
+        uint32_t exponent = (node.exponents >> (8 * axis)) & 0xff;
+        set_coord(axis, bounds.min,
+                  decode_coord(node.origin[axis], exponent,
+                               node.quantized[6 * child + axis]));
+        set_coord(axis, bounds.max,
+                  decode_coord(node.origin[axis], exponent,
+                               node.quantized[6 * child + 3 + axis]));
+    }
+    return bounds;
+}
+
+Hit trace_quantized_bvh(const std::vector<QuantizedBox> &nodes,
+                        const std::vector<TriangleForGLSL *> &triangles,
+                        const Ray &ray, TraversalStats &stats) {
+    Hit hit = no_hit();
+    std::vector<std::pair<int, float>> stack = {{0, 0.0f}};
+    while (!stack.empty()) {
+        auto [node_id, t_entry] = stack.back();
+        stack.pop_back();
+        if (t_entry >= hit.t) {
+            continue;
+        }
+        const QuantizedBox &node = nodes[node_id];
+        stats.nodes++;
+        if (node.exponents == 0) {
+            uint32_t count;
+            std::memcpy(&count, node.quantized, sizeof(count));
+            for (int i = node.index; i < node.index + static_cast<int>(count);
+                 i++) {
+                stats.triangles++;
+                float t = intersect_ray_triangle(ray, *triangles[i]);
+                if (t < hit.t) {
+                    hit = Hit{t, i};
+                }
+            }
+            continue;
+        }
+        Bounds left = quantized_child_bounds(node, 0);
+        Bounds right = quantized_child_bounds(node, 1);
+        float t_left = intersect_ray_box(ray, left.min, left.max, hit.t);
+        float t_right = intersect_ray_box(ray, right.min, right.max, hit.t);
+        stats.boxes += 2;
+        std::pair<int, float> near{node.index, t_left};
+        std::pair<int, float> far{node.index + 1, t_right};
+        if (t_right < t_left) {
+            std::swap(near, far);
+        }
+        if (far.second < hit.t) {
+            stack.push_back(far);
+        }
+        if (near.second < hit.t) {
+            stack.push_back(near);
+        }
+    }
+    return hit;
+}
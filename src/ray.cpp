@@ -0,0 +1,82 @@
+#include "./ray.hpp"
+#include "./aabb.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+const float RAY_EPSILON = 1e-6f;
+
+Ray make_ray(const PaddedVec3ForGLSL &origin,
+             const PaddedVec3ForGLSL &direction) {
+    return Ray{origin, direction,
+               PaddedVec3ForGLSL{1 / direction.x, 1 / direction.y,
+                                 1 / direction.z, 0}};
+}
+
+Hit no_hit() { return Hit{std::numeric_limits<float>::infinity(), -1}; }
+
+float intersect_ray_box(const Ray &ray, const PaddedVec3ForGLSL &min,
+                        const PaddedVec3ForGLSL &max, float t_max) {
+    float t_near = 0;
+    float t_far = t_max;
+    for (int axis = 0; axis < 3; ++axis) {
+        float origin = get_coord(axis, ray.origin);
+        float inv = get_coord(axis, ray.inv_direction);
+        float t0 = (get_coord(axis, min) - origin) * inv;
+        float t1 = (get_coord(axis, max) - origin) * inv;
+        // NaN from 0 * infinity compares false and keeps the old bound
+        t_near = std::max(t_near, std::min(t0, t1));
+        t_far = std::min(t_far, std::max(t0, t1));
+    }
+    return t_near <= t_far ? t_near : std::numeric_limits<float>::infinity();
+}
+
+float intersect_ray_edges(const Ray &ray, const PaddedVec3ForGLSL &v1,
+                          const PaddedVec3ForGLSL &e1,
+                          const PaddedVec3ForGLSL &e2) {
+    const float miss = std::numeric_limits<float>::infinity();
+    const PaddedVec3ForGLSL &d = ray.direction;
+    float p[3] = {d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z,
+                  d.x * e2.y - d.y * e2.x};
+    float determinant = e1.x * p[0] + e1.y * p[1] + e1.z * p[2];
+    if (std::fabs(determinant) < 1e-12f) {
+        return miss;
+    }
+    float inv = 1 / determinant;
+    float s[3] = {ray.origin.x - v1.x, ray.origin.y - v1.y,
+                  ray.origin.z - v1.z};
+    float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+    if (u < 0 || u > 1) {
+        return miss;
+    }
+    float q[3] = {s[1] * e1.z - s[2] * e1.y, s[2] * e1.x - s[0] * e1.z,
+                  s[0] * e1.y - s[1] * e1.x};
+    float v = (d.x * q[0] + d.y * q[1] + d.z * q[2]) * inv;
+    if (v < 0 || u + v > 1) {
+        return miss;
+    }
+    float t = (e2.x * q[0] + e2.y * q[1] + e2.z * q[2]) * inv;
+    return t > RAY_EPSILON ? t : miss;
+}
+
+float intersect_ray_vertices(const Ray &ray, const PaddedVec3ForGLSL &v1,
+                             const PaddedVec3ForGLSL &v2,
+                             const PaddedVec3ForGLSL &v3) {
+    PaddedVec3ForGLSL e1{v2.x - v1.x, v2.y - v1.y, v2.z - v1.z, 0};
+    PaddedVec3ForGLSL e2{v3.x - v1.x, v3.y - v1.y, v3.z - v1.z, 0};
+    return intersect_ray_edges(ray, v1, e1, e2);
+}
+
+float intersect_ray_triangle(const Ray &ray, const TriangleForGLSL &triangle) {
+    return intersect_ray_vertices(ray, triangle.v1, triangle.v2, triangle.v3);
+}
+
+Hit trace_bvh(const std::vector<Box> &boxes, int root_id,
+              const std::vector<TriangleForGLSL *> &triangles, const Ray &ray,
+              TraversalStats &stats, bool count_cache_lines) {
+    return trace_bvh(
+        boxes, root_id, ray, stats,
+        [&](int i) { return intersect_ray_triangle(ray, *triangles[i]); },
+        count_cache_lines);
+}
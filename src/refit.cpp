@@ -0,0 +1,144 @@
+#include "./refit.hpp"
+#include "./aabb.hpp"
+#include "./thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+const int REFIT_GRAIN = 1024;
+
+RefitPlan make_refit_plan(const std::vector<Box> &boxes, int root_id) {
+    std::vector<int> heights(boxes.size());
+    std::vector<std::pair<int, bool>> stack = {{root_id, false}};
+    int max_height = 0;
+    while (!stack.empty()) {
+        auto [box_id, children_done] = stack.back();
+        stack.pop_back();
+        const Box &box = boxes[box_id];
+        if (box.left_id == -1) {
+            heights[box_id] = 0;
+            continue;
+        }
+        if (!children_done) {
+            stack.push_back({box_id, true});
+            stack.push_back({box.left_id, false});
+            stack.push_back({box.right_id, false});
+            continue;
+        }
+        heights[box_id] =
+            1 + std::max(heights[box.left_id], heights[box.right_id]);
+        max_height = std::max(max_height, heights[box_id]);
+    }
+
+    RefitPlan plan;
+    plan.levels.resize(max_height + 1);
+    stack = {{root_id, false}};
+    while (!stack.empty()) {
+        int box_id = stack.back().first;
+        stack.pop_back();
+        plan.levels[heights[box_id]].push_back(box_id);
+        if (boxes[box_id].left_id != -1) {
+            stack.push_back({boxes[box_id].left_id, false});
+            stack.push_back({boxes[box_id].right_id, false});
+        }
+    }
+    return plan;
+}
+
+bool same_position(const PaddedVec3ForGLSL &a, const PaddedVec3ForGLSL &b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+std::vector<DirtyRange> dirty_ranges(const std::vector<char> &dirty) {
+    std::vector<DirtyRange> ranges;
+    for (int i = 0; i < static_cast<int>(dirty.size()); ++i) {
+        if (!dirty[i]) {
+            continue;
+        }
+        if (!ranges.empty() && i - ranges.back().end < REFIT_UPLOAD_GAP) {
+            ranges.back().end = i + 1;
+        } else {
+            ranges.push_back(DirtyRange{i, i + 1});
+        }
+    }
+    return ranges;
+}
+
+int range_size(const std::vector<DirtyRange> &ranges) {
+    int size = 0;
+    for (const auto &range : ranges) {
+        size += range.end - range.begin;
+    }
+    return size;
+}
+
+RefitResult refit_aabb(std::vector<Box> &boxes,
+                       std::vector<TriangleForGLSL *> &triangles,
+                       const std::vector<PaddedVec3ForGLSL> &positions,
+                       const RefitPlan &plan, ThreadPool &pool) {
+    std::vector<char> moved(triangles.size());
+    pool.parallel_for(0, triangles.size(), REFIT_GRAIN, [&](int i) {
+        TriangleForGLSL &triangle = *triangles[i];
+        const PaddedVec3ForGLSL *vertices = &positions[3 * i];
+        if (same_position(triangle.v1, vertices[0]) &&
+            same_position(triangle.v2, vertices[1]) &&
+            same_position(triangle.v3, vertices[2])) {
+            return;
+        }
+        triangle.v1 = vertices[0];
+        triangle.v2 = vertices[1];
+        triangle.v3 = vertices[2];
+        Bounds bounds = merge_bounds(
+            merge_bounds(Bounds{vertices[0], vertices[0]}, vertices[1]),
+            vertices[2]);
+        triangle.min = bounds.min;
+        triangle.max = bounds.max;
+        moved[i] = 1;
+    });
+
+    std::vector<char> changed(boxes.size());
+    for (size_t level = 0; level < plan.levels.size(); ++level) {
+        const std::vector<int> &box_ids = plan.levels[level];
+        pool.parallel_for(0, box_ids.size(), REFIT_GRAIN, [&](int i) {
+            Box &box = boxes[box_ids[i]];
+            Bounds bounds = empty_bounds();
+            if (box.left_id == -1) {
+                bool touched = false;
+                for (int t = box.start; t < box.end; t++) {
+                    touched = touched || moved[t];
+                    bounds =
+                        merge_bounds(bounds, triangle_bounds(*triangles[t]));
+                }
+                if (!touched) {
+                    return;
+                }
+            } else {
+                if (!changed[box.left_id] && !changed[box.right_id]) {
+                    return;
+                }
+                bounds = merge_bounds(box_bounds(boxes[box.left_id]),
+                                      box_bounds(boxes[box.right_id]));
+            }
+            box.min = bounds.min;
+            box.max = bounds.max;
+            changed[box_ids[i]] = 1;
+        });
+    }
+
+    return RefitResult{dirty_ranges(moved), dirty_ranges(changed)};
+}
+
+std::vector<PaddedVec3ForGLSL>
+wave_positions(const std::vector<TriangleForGLSL> &triangles, float amplitude,
+               float wavelength, float phase) {
+    std::vector<PaddedVec3ForGLSL> positions;
+    positions.reserve(3 * triangles.size());
+    for (const auto &triangle : triangles) {
+        for (PaddedVec3ForGLSL vertex :
+             {triangle.v1, triangle.v2, triangle.v3}) {
+            vertex.y += amplitude * std::sin(vertex.x / wavelength + phase);
+            positions.push_back(vertex);
+        }
+    }
+    return positions;
+}
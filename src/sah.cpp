@@ -0,0 +1,153 @@
+#include "./sah.hpp"
+#include "./aabb.hpp"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+int sah_bin_index(float centroid, float centroid_min, float scale,
+                  int bin_count) {
+    int bin = static_cast<int>((centroid - centroid_min) * scale);
+    return std::max(0, std::min(bin_count - 1, bin));
+}
+
+SAHSplit find_sah_split(const std::vector<SAHPrimitive> &primitives, int start,
+                        int end, const Bounds &bounds, const Bounds &centroids,
+                        const BuildParams &params) {
+    SAHSplit best{-1, 0, std::numeric_limits<float>::max(), empty_bounds(),
+                  empty_bounds()};
+    float area = surface_area(bounds);
+    if (area <= 0) {
+        return best;
+    }
+    int bin_count = std::max(2, params.bin_count);
+    std::vector<SAHBin> bins(bin_count);
+    std::vector<Bounds> right_bounds(bin_count);
+    std::vector<int> right_counts(bin_count);
+    for (int axis = 0; axis < 3; ++axis) {
+        float centroid_min = get_coord(axis, centroids.min);
+        float extent = get_coord(axis, centroids.max) - centroid_min;
+        if (extent <= 0) {
+            continue;
+        }
+        float scale = bin_count / extent;
+        std::fill(bins.begin(), bins.end(), SAHBin{empty_bounds(), 0});
+        for (int i = start; i < end; i++) {
+            SAHBin &bin = bins[sah_bin_index(
+                get_coord(axis, primitives[i].centroid), centroid_min, scale,
+                bin_count)];
+            bin.bounds = merge_bounds(bin.bounds, primitives[i].bounds);
+            bin.count++;
+        }
+
+        // right_bounds[i] and right_counts[i] cover bins [i, bin_count)
+        Bounds right = empty_bounds();
+        int right_count = 0;
+        for (int i = bin_count - 1; i > 0; --i) {
+            right = merge_bounds(right, bins[i].bounds);
+            right_count += bins[i].count;
+            right_bounds[i] = right;
+            right_counts[i] = right_count;
+        }
+        Bounds left = empty_bounds();
+        int left_count = 0;
+        for (int i = 0; i < bin_count - 1; ++i) {
+            left = merge_bounds(left, bins[i].bounds);
+            left_count += bins[i].count;
+            if (left_count == 0 || left_count == end - start) {
+                continue;
+            }
+            float cost = params.traversal_cost +
+                         params.intersection_cost *
+                             (surface_area(left) * left_count +
+                              surface_area(right_bounds[i + 1]) *
+                                  right_counts[i + 1]) /
+                             area;
+            if (cost < best.cost) {
+                best = SAHSplit{axis, i + 1, cost, left, right_bounds[i + 1]};
+            }
+        }
+    }
+    return best;
+}
+
+int partition_sah_split(std::vector<SAHPrimitive> &primitives, int start,
+                        int end, const Bounds &centroids, const SAHSplit &split,
+                        const BuildParams &params) {
+    int mid = start + (end - start) / 2;
+    if (split.axis == -1) {
+        return mid;
+    }
+    int bin_count = std::max(2, params.bin_count);
+    float centroid_min = get_coord(split.axis, centroids.min);
+    float scale =
+        bin_count / (get_coord(split.axis, centroids.max) - centroid_min);
+    auto middle = std::partition(
+        primitives.begin() + start, primitives.begin() + end,
+        [&](const SAHPrimitive &p) {
+            return sah_bin_index(get_coord(split.axis, p.centroid),
+                                 centroid_min, scale, bin_count) < split.bin;
+        });
+    int partitioned = static_cast<int>(middle - primitives.begin());
+    if (partitioned == start || partitioned == end) {
+        return mid;
+    }
+    return partitioned;
+}
+
+Box build_sah_node(std::vector<Box> &boxes,
+                   std::vector<SAHPrimitive> &primitives, int start, int end,
+                   const BuildParams &params) {
+    Bounds bounds = empty_bounds();
+    Bounds centroids = empty_bounds();
+    for (int i = start; i < end; i++) {
+        bounds = merge_bounds(bounds, primitives[i].bounds);
+        centroids = merge_bounds(centroids, primitives[i].centroid);
+    }
+
+    int span = end - start;
+    if (span <= 1) {
+        return Box(bounds.min, bounds.max, -1, -1, start, end);
+    }
+
+    SAHSplit split =
+        find_sah_split(primitives, start, end, bounds, centroids, params);
+    float leaf_cost = params.intersection_cost * span;
+    if (span <= params.leaf_size &&
+        (split.axis == -1 || leaf_cost <= split.cost)) {
+        return Box(bounds.min, bounds.max, -1, -1, start, end);
+    }
+
+    int mid = partition_sah_split(primitives, start, end, centroids, split,
+                                  params);
+
+    boxes.emplace_back(build_sah_node(boxes, primitives, start, mid, params));
+    int left = boxes.size() - 1;
+    boxes.emplace_back(build_sah_node(boxes, primitives, mid, end, params));
+    int right = boxes.size() - 1;
+
+    return Box(bounds.min, bounds.max, left, right, start, end);
+}
+
+Box triangles_to_box_sah(std::vector<Box> &boxes,
+                         std::vector<TriangleForGLSL *> &triangles, int start,
+                         int end, const BuildParams &params) {
+    std::vector<SAHPrimitive> primitives(triangles.size());
+    for (int i = start; i < end; i++) {
+        Bounds bounds = triangle_bounds(*triangles[i]);
+        primitives[i] =
+            SAHPrimitive{bounds, bounds_center(bounds), triangles[i]};
+    }
+    Box box = build_sah_node(boxes, primitives, start, end, params);
+    for (int i = start; i < end; i++) {
+        triangles[i] = primitives[i].triangle;
+    }
+    return box;
+}
+
+AABB *triangles_to_aabb_sah(std::vector<Box> &boxes,
+                            std::vector<TriangleForGLSL *> &triangles,
+                            const BuildParams &params) {
+    boxes.emplace_back(triangles_to_box_sah(boxes, triangles, 0,
+                                            triangles.size(), params));
+    return new AABB{static_cast<int>(boxes.size() - 1)};
+}
@@ -0,0 +1,319 @@
+#include "./sbvh.hpp"
+#include "./aabb.hpp"
+#include "./sah.hpp"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Below this depth only object splits are made, they always shrink a node
+const int SBVH_MAX_SPATIAL_DEPTH = 48;
+
+struct SpatialBin {
+    Bounds bounds;
+    int entries;
+    int exits;
+};
+
+struct SpatialSplit {
+    int axis;
+    float position;
+    float cost;
+    Bounds left;
+    Bounds right;
+    int left_count;
+    int right_count;
+};
+
+struct SBVHState {
+    std::vector<Box> &boxes;
+    std::vector<TriangleForGLSL *> &references;
+    const BuildParams &params;
+    int duplicates_left;
+    float root_area;
+};
+
+bool is_empty(const Bounds &bounds) {
+    return bounds.min.x > bounds.max.x || bounds.min.y > bounds.max.y ||
+           bounds.min.z > bounds.max.z;
+}
+
+Bounds clip_triangle(const TriangleForGLSL &triangle, int axis, float low,
+                     float high) {
+    const PaddedVec3ForGLSL *vertices[3] = {&triangle.v1, &triangle.v2,
+                                            &triangle.v3};
+    Bounds clipped = empty_bounds();
+    for (int i = 0; i < 3; ++i) {
+        const PaddedVec3ForGLSL &a = *vertices[i];
+        const PaddedVec3ForGLSL &b = *vertices[(i + 1) % 3];
+        float coord_a = get_coord(axis, a);
+        float coord_b = get_coord(axis, b);
+        if (coord_a >= low && coord_a <= high) {
+            clipped = merge_bounds(clipped, a);
+        }
+        for (float plane : {low, high}) {
+            if ((coord_a < plane && coord_b > plane) ||
+                (coord_a > plane && coord_b < plane)) {
+                float t = (plane - coord_a) / (coord_b - coord_a);
+                PaddedVec3ForGLSL point{a.x + (b.x - a.x) * t,
+                                        a.y + (b.y - a.y) * t,
+                                        a.z + (b.z - a.z) * t, 0};
+                set_coord(axis, point, plane);
+                clipped = merge_bounds(clipped, point);
+            }
+        }
+    }
+    return clipped;
+}
+
+// Part of a reference between `low` and `high`, empty if there is none
+Bounds clip_reference(const SAHPrimitive &reference, int axis, float low,
+                      float high) {
+    return intersect_bounds(
+        clip_triangle(*reference.triangle, axis, low, high), reference.bounds);
+}
+
+SpatialSplit find_spatial_split(const std::vector<SAHPrimitive> &references,
+                                const Bounds &bounds,
+                                const BuildParams &params) {
+    SpatialSplit best{-1, 0, std::numeric_limits<float>::max(),
+                      empty_bounds(), empty_bounds(), 0, 0};
+    float area = surface_area(bounds);
+    int count = references.size();
+    if (area <= 0) {
+        return best;
+    }
+    int bin_count = std::max(2, params.bin_count);
+    std::vector<SpatialBin> bins(bin_count);
+    std::vector<Bounds> right_bounds(bin_count);
+    std::vector<int> right_counts(bin_count);
+    for (int axis = 0; axis < 3; ++axis) {
+        float low = get_coord(axis, bounds.min);
+        float high = get_coord(axis, bounds.max);
+        float width = (high - low) / bin_count;
+        if (width <= 0) {
+            continue;
+        }
+        std::fill(bins.begin(), bins.end(), SpatialBin{empty_bounds(), 0, 0});
+        for (const auto &reference : references) {
+            int first = sah_bin_index(get_coord(axis, reference.bounds.min),
+                                      low, 1 / width, bin_count);
+            int last = sah_bin_index(get_coord(axis, reference.bounds.max),
+                                     low, 1 / width, bin_count);
+            last = std::max(first, last);
+            if (first == last) {
+                bins[first].bounds =
+                    merge_bounds(bins[first].bounds, reference.bounds);
+            } else {
+                for (int bin = first; bin <= last; ++bin) {
+                    float bin_low = low + bin * width;
+                    float bin_high =
+                        bin == bin_count - 1 ? high : bin_low + width;
+                    bins[bin].bounds = merge_bounds(
+                        bins[bin].bounds,
+                        clip_reference(reference, axis, bin_low, bin_high));
+                }
+            }
+            bins[first].entries++;
+            bins[last].exits++;
+        }
+
+        Bounds right = empty_bounds();
+        int right_count = 0;
+        for (int i = bin_count - 1; i > 0; --i) {
+            right = merge_bounds(right, bins[i].bounds);
+            right_count += bins[i].exits;
+            right_bounds[i] = right;
+            right_counts[i] = right_count;
+        }
+        Bounds left = empty_bounds();
+        int left_count = 0;
+        for (int i = 0; i < bin_count - 1; ++i) {
+            left = merge_bounds(left, bins[i].bounds);
+            left_count += bins[i].entries;
+            int right_side = right_counts[i + 1];
+            // A side holding every reference would never terminate
+            if (left_count == 0 || right_side == 0 || left_count == count ||
+                right_side == count) {
+                continue;
+            }
+            float cost = params.traversal_cost +
+                         params.intersection_cost *
+                             (surface_area(left) * left_count +
+                              surface_area(right_bounds[i + 1]) * right_side) /
+                             area;
+            if (cost < best.cost) {
+                best = SpatialSplit{axis,
+                                    low + (i + 1) * width,
+                                    cost,
+                                    left,
+                                    right_bounds[i + 1],
+                                    left_count,
+                                    right_side};
+            }
+        }
+    }
+    return best;
+}
+
+// Distributes the references over both sides of the plane. A straddling
+// reference is either clipped into both sides, using one duplicate, or kept
+// whole on one side when that is cheaper ("reference unsplitting").
+void perform_spatial_split(SBVHState &state,
+                           const std::vector<SAHPrimitive> &references,
+                           SpatialSplit split,
+                           std::vector<SAHPrimitive> &left,
+                           std::vector<SAHPrimitive> &right) {
+    int axis = split.axis;
+    for (const auto &reference : references) {
+        float low = get_coord(axis, reference.bounds.min);
+        float high = get_coord(axis, reference.bounds.max);
+        if (high <= split.position) {
+            left.push_back(reference);
+            continue;
+        }
+        if (low >= split.position) {
+            right.push_back(reference);
+            continue;
+        }
+
+        float left_area = surface_area(split.left);
+        float right_area = surface_area(split.right);
+        float split_cost =
+            left_area * split.left_count + right_area * split.right_count;
+        float left_cost =
+            surface_area(merge_bounds(split.left, reference.bounds)) *
+                split.left_count +
+            right_area * (split.right_count - 1);
+        float right_cost =
+            left_area * (split.left_count - 1) +
+            surface_area(merge_bounds(split.right, reference.bounds)) *
+                split.right_count;
+        bool keep_left = left_cost < split_cost && left_cost <= right_cost;
+        bool keep_right = !keep_left && right_cost < split_cost;
+        if (state.duplicates_left <= 0 && !keep_left && !keep_right) {
+            keep_left = get_coord(axis, reference.centroid) < split.position;
+            keep_right = !keep_left;
+        }
+        if (keep_left) {
+            left.push_back(reference);
+            split.left = merge_bounds(split.left, reference.bounds);
+            split.right_count--;
+            continue;
+        }
+        if (keep_right) {
+            right.push_back(reference);
+            split.right = merge_bounds(split.right, reference.bounds);
+            split.left_count--;
+            continue;
+        }
+
+        Bounds left_part = clip_reference(reference, axis, low, split.position);
+        Bounds right_part =
+            clip_reference(reference, axis, split.position, high);
+        if (is_empty(left_part)) {
+            right.push_back(reference);
+        } else if (is_empty(right_part)) {
+            left.push_back(reference);
+        } else {
+            left.push_back(SAHPrimitive{left_part, bounds_center(left_part),
+                                        reference.triangle});
+            right.push_back(SAHPrimitive{
+                right_part, bounds_center(right_part), reference.triangle});
+            state.duplicates_left--;
+        }
+    }
+}
+
+Box build_sbvh_node(SBVHState &state, std::vector<SAHPrimitive> &references,
+                    int depth) {
+    int start = state.references.size();
+    int count = references.size();
+    Bounds bounds = empty_bounds();
+    Bounds centroids = empty_bounds();
+    for (const auto &reference : references) {
+        bounds = merge_bounds(bounds, reference.bounds);
+        centroids = merge_bounds(centroids, reference.centroid);
+    }
+
+    SAHSplit object_split{-1, 0, std::numeric_limits<float>::max(),
+                          empty_bounds(), empty_bounds()};
+    SpatialSplit spatial_split{-1, 0, std::numeric_limits<float>::max(),
+                               empty_bounds(), empty_bounds(), 0, 0};
+    if (count > 1) {
+        object_split = find_sah_split(references, 0, count, bounds, centroids,
+                                      state.params);
+        float overlap = surface_area(
+            intersect_bounds(object_split.left, object_split.right));
+        if (depth < SBVH_MAX_SPATIAL_DEPTH && state.duplicates_left > 0 &&
+            (object_split.axis == -1 ||
+             overlap > state.params.split_alpha * state.root_area)) {
+            spatial_split =
+                find_spatial_split(references, bounds, state.params);
+        }
+    }
+
+    float split_cost = std::min(object_split.cost, spatial_split.cost);
+    float leaf_cost = state.params.intersection_cost * count;
+    if (count <= 1 ||
+        (count <= state.params.leaf_size && leaf_cost <= split_cost)) {
+        for (const auto &reference : references) {
+            state.references.push_back(reference.triangle);
+        }
+        return Box(bounds.min, bounds.max, -1, -1, start, start + count);
+    }
+
+    std::vector<SAHPrimitive> left;
+    std::vector<SAHPrimitive> right;
+    if (spatial_split.cost < object_split.cost) {
+        perform_spatial_split(state, references, spatial_split, left, right);
+        if (left.empty() || right.empty() ||
+            static_cast<int>(left.size()) == count ||
+            static_cast<int>(right.size()) == count) {
+            left.clear();
+            right.clear();
+        }
+    }
+    if (left.empty()) {
+        int mid = partition_sah_split(references, 0, count, centroids,
+                                      object_split, state.params);
+        left.assign(references.begin(), references.begin() + mid);
+        right.assign(references.begin() + mid, references.end());
+    }
+    std::vector<SAHPrimitive>().swap(references);
+
+    state.boxes.emplace_back(build_sbvh_node(state, left, depth + 1));
+    int left_id = state.boxes.size() - 1;
+    state.boxes.emplace_back(build_sbvh_node(state, right, depth + 1));
+    int right_id = state.boxes.size() - 1;
+
+    Bounds children = merge_bounds(box_bounds(state.boxes[left_id]),
+                                   box_bounds(state.boxes[right_id]));
+    return Box(children.min, children.max, left_id, right_id, start,
+               state.references.size());
+}
+
+AABB *triangles_to_aabb_sbvh(std::vector<Box> &boxes,
+                             std::vector<TriangleForGLSL *> &triangles,
+                             const BuildParams &params) {
+    std::vector<SAHPrimitive> references;
+    references.reserve(triangles.size());
+    Bounds bounds = empty_bounds();
+    for (auto *triangle : triangles) {
+        Bounds triangle_box = triangle_bounds(*triangle);
+        references.push_back(
+            SAHPrimitive{triangle_box, bounds_center(triangle_box), triangle});
+        bounds = merge_bounds(bounds, triangle_box);
+    }
+
+    std::vector<TriangleForGLSL *> reference_list;
+    reference_list.reserve(
+        triangles.size() +
+        static_cast<size_t>(triangles.size() * params.duplication_budget));
+    SBVHState state{boxes, reference_list, params,
+                    static_cast<int>(triangles.size() *
+                                     params.duplication_budget),
+                    surface_area(bounds)};
+    boxes.emplace_back(build_sbvh_node(state, references, 0));
+    triangles.swap(reference_list);
+    return new AABB{static_cast<int>(boxes.size() - 1)};
+}
@@ -0,0 +1,222 @@
+#include "./scene.hpp"
+#include "./aabb.hpp"
+#include "./load_model.hpp"
+#include "./thread_pool.hpp"
+#include <algorithm>
+#include <vector>
+
+const Matrix4 IDENTITY_MATRIX{Vec4{1, 0, 0, 0}, Vec4{0, 1, 0, 0},
+                              Vec4{0, 0, 1, 0}, Vec4{0, 0, 0, 1}};
+
+Transform make_transform(const Matrix4 &matrix) {
+    Transform transform;
+    const Vec4 *rows[3] = {&matrix.v1, &matrix.v2, &matrix.v3};
+    for (int i = 0; i < 3; ++i) {
+        transform.rows[i] = Vec4ForGLSL{static_cast<float>(rows[i]->x),
+                                        static_cast<float>(rows[i]->y),
+                                        static_cast<float>(rows[i]->z),
+                                        static_cast<float>(rows[i]->w)};
+    }
+    return transform;
+}
+
+Transform inverse_transform(const Transform &transform) {
+    const Vec4ForGLSL *r = transform.rows;
+    // Adjugate of the 3x3 part divided by its determinant
+    double a[3][3] = {
+        {r[1].y * r[2].z - r[1].z * r[2].y, r[0].z * r[2].y - r[0].y * r[2].z,
+         r[0].y * r[1].z - r[0].z * r[1].y},
+        {r[1].z * r[2].x - r[1].x * r[2].z, r[0].x * r[2].z - r[0].z * r[2].x,
+         r[0].z * r[1].x - r[0].x * r[1].z},
+        {r[1].x * r[2].y - r[1].y * r[2].x, r[0].y * r[2].x - r[0].x * r[2].y,
+         r[0].x * r[1].y - r[0].y * r[1].x}};
+    double determinant = r[0].x * a[0][0] + r[0].y * a[1][0] + r[0].z * a[2][0];
+    double scale = determinant != 0 ? 1 / determinant : 0;
+    Transform inverse;
+    for (int i = 0; i < 3; ++i) {
+        double x = a[i][0] * scale;
+        double y = a[i][1] * scale;
+        double z = a[i][2] * scale;
+        inverse.rows[i] = Vec4ForGLSL{
+            static_cast<float>(x), static_cast<float>(y), static_cast<float>(z),
+            static_cast<float>(-(x * r[0].w + y * r[1].w + z * r[2].w))};
+    }
+    return inverse;
+}
+
+PaddedVec3ForGLSL transform_point(const Transform &transform,
+                                  const PaddedVec3ForGLSL &point) {
+    const Vec4ForGLSL *r = transform.rows;
+    return PaddedVec3ForGLSL{
+        r[0].x * point.x + r[0].y * point.y + r[0].z * point.z + r[0].w,
+        r[1].x * point.x + r[1].y * point.y + r[1].z * point.z + r[1].w,
+        r[2].x * point.x + r[2].y * point.y + r[2].z * point.z + r[2].w, 0};
+}
+
+// `mesh_ids` maps the glTF mesh indices of the model to scene meshes
+void add_node_to_scene(Scene &scene, const OurNode &node,
+                       const std::vector<std::vector<Triangle>> &meshes,
+                       std::vector<int> &mesh_ids, const Matrix4 &parent) {
+    Matrix4 world = mul_matrixes(parent, node.matrix);
+    if (node.mesh > -1 && !meshes[node.mesh].empty()) {
+        if (mesh_ids[node.mesh] == -1) {
+            Mesh mesh;
+            mesh.triangles.reserve(meshes[node.mesh].size());
+            for (const auto &primitive : meshes[node.mesh]) {
+                mesh.triangles.push_back(
+                    triangle_for_glsl(primitive, IDENTITY_MATRIX));
+            }
+            mesh_ids[node.mesh] = scene.meshes.size();
+            scene.meshes.push_back(std::move(mesh));
+        }
+        scene.instances.push_back(
+            Instance{mesh_ids[node.mesh], make_transform(world)});
+    }
+    for (const auto &child : node.children) {
+        add_node_to_scene(scene, child, meshes, mesh_ids, world);
+    }
+}
+
+void add_node_to_scene(Scene &scene, const OurNode &node) {
+    std::vector<int> mesh_ids(node.meshes.size(), -1);
+    add_node_to_scene(scene, node, node.meshes, mesh_ids, IDENTITY_MATRIX);
+}
+
+void build_blas(Scene &scene, int builder, const BuildParams &params,
+                ThreadPool &pool) {
+    pool.parallel_for(0, scene.meshes.size(), 1, [&](int mesh_id) {
+        Mesh &mesh = scene.meshes[mesh_id];
+        std::vector<TriangleForGLSL *> triangles;
+        triangles.reserve(mesh.triangles.size());
+        for (auto &triangle : mesh.triangles) {
+            triangles.push_back(&triangle);
+        }
+        mesh.boxes.clear();
+        AABB *aabb = build_aabb(mesh.boxes, triangles, builder, params, pool);
+        mesh.root_id = aabb->root_id;
+        delete aabb;
+        // Copies, since sbvh may reference a triangle from several leaves
+        std::vector<TriangleForGLSL> ordered;
+        ordered.reserve(triangles.size());
+        for (const auto *triangle : triangles) {
+            ordered.push_back(*triangle);
+        }
+        mesh.triangles.swap(ordered);
+    });
+
+    int triangle_offset = 0;
+    int box_offset = 0;
+    for (auto &mesh : scene.meshes) {
+        mesh.triangle_offset = triangle_offset;
+        mesh.box_offset = box_offset;
+        triangle_offset += mesh.triangles.size();
+        box_offset += mesh.boxes.size();
+    }
+}
+
+Bounds instance_bounds(const Scene &scene, const Instance &instance) {
+    const Mesh &mesh = scene.meshes[instance.mesh_id];
+    const Box &root = mesh.boxes[mesh.root_id];
+    Bounds bounds = empty_bounds();
+    for (int corner = 0; corner < 8; ++corner) {
+        PaddedVec3ForGLSL point{corner & 1 ? root.max.x : root.min.x,
+                                corner & 2 ? root.max.y : root.min.y,
+                                corner & 4 ? root.max.z : root.min.z, 0};
+        bounds =
+            merge_bounds(bounds, transform_point(instance.transform, point));
+    }
+    return bounds;
+}
+
+// Splits at the median centroid along the widest axis, one instance per leaf
+Box build_tlas_node(std::vector<Box> &tlas, std::vector<int> &instance_ids,
+                    const std::vector<Bounds> &bounds, int start, int end) {
+    if (end - start == 1) {
+        const Bounds &leaf = bounds[instance_ids[start]];
+        return Box(leaf.min, leaf.max, -1, -1, instance_ids[start],
+                   instance_ids[start] + 1);
+    }
+    Bounds centroids = empty_bounds();
+    for (int i = start; i < end; ++i) {
+        centroids =
+            merge_bounds(centroids, bounds_center(bounds[instance_ids[i]]));
+    }
+    int axis = 0;
+    for (int coord = 1; coord < 3; ++coord) {
+        if (get_coord(coord, centroids.max) - get_coord(coord, centroids.min) >
+            get_coord(axis, centroids.max) - get_coord(axis, centroids.min)) {
+            axis = coord;
+        }
+    }
+    int mid = start + (end - start) / 2;
+    std::nth_element(instance_ids.begin() + start, instance_ids.begin() + mid,
+                     instance_ids.begin() + end, [&](int a, int b) {
+                         return get_coord(axis, bounds_center(bounds[a])) <
+                                get_coord(axis, bounds_center(bounds[b]));
+                     });
+
+    tlas.emplace_back(build_tlas_node(tlas, instance_ids, bounds, start, mid));
+    int left = tlas.size() - 1;
+    tlas.emplace_back(build_tlas_node(tlas, instance_ids, bounds, mid, end));
+    int right = tlas.size() - 1;
+
+    Bounds merged =
+        merge_bounds(box_bounds(tlas[left]), box_bounds(tlas[right]));
+    return Box(merged.min, merged.max, left, right, 0, 0);
+}
+
+void build_tlas(Scene &scene) {
+    scene.tlas.clear();
+    scene.tlas_root_id = -1;
+    if (scene.instances.empty()) {
+        return;
+    }
+    std::vector<Bounds> bounds;
+    std::vector<int> instance_ids;
+    bounds.reserve(scene.instances.size());
+    for (const auto &instance : scene.instances) {
+        instance_ids.push_back(bounds.size());
+        bounds.push_back(instance_bounds(scene, instance));
+    }
+    scene.tlas.reserve(2 * scene.instances.size() - 1);
+    scene.tlas.emplace_back(build_tlas_node(scene.tlas, instance_ids, bounds, 0,
+                                            instance_ids.size()));
+    scene.tlas_root_id = scene.tlas.size() - 1;
+}
+
+std::vector<TriangleForGLSL> scene_triangles(const Scene &scene) {
+    std::vector<TriangleForGLSL> triangles;
+    for (const auto &mesh : scene.meshes) {
+        triangles.insert(triangles.end(), mesh.triangles.begin(),
+                         mesh.triangles.end());
+    }
+    return triangles;
+}
+
+std::vector<Box> scene_blas_boxes(const Scene &scene) {
+    std::vector<Box> boxes;
+    for (const auto &mesh : scene.meshes) {
+        for (Box box : mesh.boxes) {
+            if (box.left_id != -1) {
+                box.left_id += mesh.box_offset;
+                box.right_id += mesh.box_offset;
+            }
+            box.start += mesh.triangle_offset;
+            box.end += mesh.triangle_offset;
+            boxes.push_back(box);
+        }
+    }
+    return boxes;
+}
+
+std::vector<InstanceForGLSL> scene_instances(const Scene &scene) {
+    std::vector<InstanceForGLSL> instances;
+    instances.reserve(scene.instances.size());
+    for (const auto &instance : scene.instances) {
+        const Mesh &mesh = scene.meshes[instance.mesh_id];
+        instances.push_back(InstanceForGLSL{
+            instance.transform, inverse_transform(instance.transform),
+            mesh.box_offset + mesh.root_id, instance.mesh_id, {0, 0}});
+    }
+    return instances;
+}
@@ -0,0 +1,189 @@
+#include "./ssbo.hpp"
+#include "./dynamic_bvh.hpp"
+#include "./scene.hpp"
+#include "./use_opengl.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+GLuint create_ssbo(GLuint binding, const void *data, size_t size) {
+    GLuint ssbo;
+    glGenBuffers(1, &ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return ssbo;
+}
+
+void update_ssbo(GLuint ssbo, size_t offset, const void *data, size_t size) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, data);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void replace_ssbo(GLuint ssbo, const void *data, size_t size) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+SceneBuffers create_scene_ssbos(const Scene &scene) {
+    std::vector<TriangleForGLSL> triangles = scene_triangles(scene);
+    std::vector<Box> boxes = scene_blas_boxes(scene);
+    std::vector<InstanceForGLSL> instances = scene_instances(scene);
+    return SceneBuffers{
+        create_ssbo(SSBO_TRIANGLES, triangles.data(),
+                    triangles.size() * sizeof(TriangleForGLSL)),
+        create_ssbo(SSBO_BOXES, boxes.data(), boxes.size() * sizeof(Box)),
+        create_ssbo(SSBO_INSTANCES, instances.data(),
+                    instances.size() * sizeof(InstanceForGLSL)),
+        create_ssbo(SSBO_TLAS_BOXES, scene.tlas.data(),
+                    scene.tlas.size() * sizeof(Box))};
+}
+
+void upload_tlas(const SceneBuffers &buffers, const Scene &scene) {
+    std::vector<InstanceForGLSL> instances = scene_instances(scene);
+    replace_ssbo(buffers.instances, instances.data(),
+                 instances.size() * sizeof(InstanceForGLSL));
+    replace_ssbo(buffers.tlas, scene.tlas.data(),
+                 scene.tlas.size() * sizeof(Box));
+}
+
+// Uploads `make(*triangles[i])` for every i in the ranges
+template <typename Make>
+void upload_triangle_ranges(GLuint ssbo,
+                            const std::vector<TriangleForGLSL *> &triangles,
+                            const std::vector<DirtyRange> &ranges,
+                            const Make &make) {
+    using Entry = decltype(make(*triangles[0]));
+    std::vector<Entry> changed;
+    for (const auto &range : ranges) {
+        changed.clear();
+        for (int i = range.begin; i < range.end; ++i) {
+            changed.push_back(make(*triangles[i]));
+        }
+        update_ssbo(ssbo, range.begin * sizeof(Entry), changed.data(),
+                    changed.size() * sizeof(Entry));
+    }
+}
+
+void upload_refit(const FlatBuffers &buffers, int triangle_streams,
+                  const std::vector<TriangleForGLSL *> &triangles,
+                  const std::vector<MaterialForGLSL> &materials,
+                  const std::vector<TriangleIndices> &indices,
+                  std::vector<PaddedVec3ForGLSL> &welded_vertices,
+                  const std::vector<Box> &boxes, const RefitResult &result) {
+    if (triangle_streams == TRIANGLES_SPLIT) {
+        upload_triangle_ranges(buffers.geometry, triangles, result.triangles,
+                               [&](const TriangleForGLSL &triangle) {
+                                   return triangle_geometry(triangle,
+                                                            materials);
+                               });
+    } else if (triangle_streams == TRIANGLES_PRECOMPUTED) {
+        upload_triangle_ranges(buffers.edges, triangles, result.triangles,
+                               [&](const TriangleForGLSL &triangle) {
+                                   return triangle_edges(triangle, materials);
+                               });
+    } else if (triangle_streams == TRIANGLES_INDEXED) {
+        // Every triangle sharing a vertex moved it to the same place
+        std::vector<char> moved(welded_vertices.size());
+        auto move = [&](uint32_t vertex, const PaddedVec3ForGLSL &position) {
+            welded_vertices[vertex] =
+                PaddedVec3ForGLSL{position.x, position.y, position.z, 0};
+            moved[vertex] = 1;
+        };
+        for (const auto &range : result.triangles) {
+            for (int i = range.begin; i < range.end; ++i) {
+                move(indices[i].v1, triangles[i]->v1);
+                move(indices[i].v2, triangles[i]->v2);
+                move(indices[i].v3, triangles[i]->v3);
+            }
+        }
+        for (const auto &range : dirty_ranges(moved)) {
+            update_ssbo(buffers.welded_vertices,
+                        range.begin * sizeof(PaddedVec3ForGLSL),
+                        &welded_vertices[range.begin],
+                        (range.end - range.begin) * sizeof(PaddedVec3ForGLSL));
+        }
+    } else {
+        upload_triangle_ranges(
+            buffers.triangles, triangles, result.triangles,
+            [](const TriangleForGLSL &triangle) { return triangle; });
+    }
+    for (const auto &range : result.boxes) {
+        update_ssbo(buffers.boxes, range.begin * sizeof(Box),
+                    &boxes[range.begin],
+                    (range.end - range.begin) * sizeof(Box));
+    }
+}
+
+// Dirty boxes this close together are uploaded in one call
+const int DYNAMIC_UPLOAD_GAP = 64;
+
+// Moves `ssbo` into a new buffer of `capacity` bytes bound to `binding`.
+// The first `size` bytes are copied on the GPU and the old buffer is
+// deleted, rather than orphaned by glBufferData and uploaded again.
+void grow_ssbo(GLuint &ssbo, GLuint binding, size_t size, size_t capacity) {
+    GLuint grown;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_DYNAMIC_COPY);
+    if (size > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, ssbo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, grown);
+    ssbo = grown;
+}
+
+DynamicBuffers create_dynamic_ssbos(DynamicBVH &bvh) {
+    DynamicBuffers buffers{create_ssbo(SSBO_TRIANGLES, nullptr, 0),
+                           create_ssbo(SSBO_BOXES, nullptr, 0), 0, 0};
+    upload_dynamic(buffers, bvh);
+    return buffers;
+}
+
+void upload_dynamic(DynamicBuffers &buffers, DynamicBVH &bvh) {
+    // Everything uploaded so far lies below the old capacity, what was
+    // added since is in the dirty lists
+    if (bvh.triangles.size() > buffers.triangle_capacity) {
+        size_t capacity =
+            std::max(bvh.triangles.size(), 2 * buffers.triangle_capacity);
+        grow_ssbo(buffers.triangles, SSBO_TRIANGLES,
+                  buffers.triangle_capacity * sizeof(TriangleForGLSL),
+                  capacity * sizeof(TriangleForGLSL));
+        buffers.triangle_capacity = capacity;
+    }
+    for (const auto &range : bvh.dirty_triangles) {
+        update_ssbo(buffers.triangles, range.begin * sizeof(TriangleForGLSL),
+                    &bvh.triangles[range.begin],
+                    (range.end - range.begin) * sizeof(TriangleForGLSL));
+    }
+    bvh.dirty_triangles.clear();
+
+    if (bvh.boxes.size() > buffers.box_capacity) {
+        size_t capacity = std::max(bvh.boxes.size(), 2 * buffers.box_capacity);
+        grow_ssbo(buffers.boxes, SSBO_BOXES,
+                  buffers.box_capacity * sizeof(Box), capacity * sizeof(Box));
+        buffers.box_capacity = capacity;
+    }
+    std::vector<int> &dirty = bvh.dirty_boxes;
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    for (size_t i = 0; i < dirty.size();) {
+        size_t last = i;
+        while (last + 1 < dirty.size() &&
+               dirty[last + 1] - dirty[last] <= DYNAMIC_UPLOAD_GAP) {
+            ++last;
+        }
+        update_ssbo(buffers.boxes, dirty[i] * sizeof(Box), &bvh.boxes[dirty[i]],
+                    (dirty[last] - dirty[i] + 1) * sizeof(Box));
+        i = last + 1;
+    }
+    dirty.clear();
+}
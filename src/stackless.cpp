@@ -0,0 +1,138 @@
+#include "./stackless.hpp"
+#include "./aabb.hpp"
+#include "./ray.hpp"
+#include <vector>
+
+std::vector<StacklessLink> stackless_links(const std::vector<Box> &boxes,
+                                           int root_id) {
+    std::vector<StacklessLink> links(boxes.size(), StacklessLink{-1, -1});
+    std::vector<int> stack = {root_id};
+    while (!stack.empty()) {
+        int box_id = stack.back();
+        stack.pop_back();
+        const Box &box = boxes[box_id];
+        if (box.left_id == -1) {
+            continue;
+        }
+        links[box.left_id] = StacklessLink{box_id, box.right_id};
+        links[box.right_id] = StacklessLink{box_id, links[box_id].skip};
+        stack.push_back(box.right_id);
+        stack.push_back(box.left_id);
+    }
+    return links;
+}
+
+void intersect_leaf(const Box &box,
+                    const std::vector<TriangleForGLSL *> &triangles,
+                    const Ray &ray, Hit &hit, TraversalStats &stats) {
+    for (int i = box.start; i < box.end; i++) {
+        stats.triangles++;
+        float t = intersect_ray_triangle(ray, *triangles[i]);
+        if (t < hit.t) {
+            hit = Hit{t, i};
+        }
+    }
+}
+
+Hit trace_bvh_skip(const std::vector<Box> &boxes, int root_id,
+                   const std::vector<StacklessLink> &links,
+                   const std::vector<TriangleForGLSL *> &triangles,
+                   const Ray &ray, TraversalStats &stats) {
+    Hit hit = no_hit();
+    int box_id = root_id;
+    while (box_id != -1) {
+        const Box &box = boxes[box_id];
+        stats.boxes++;
+        if (intersect_ray_box(ray, box.min, box.max, hit.t) >= hit.t) {
+            box_id = links[box_id].skip;
+            continue;
+        }
+        stats.nodes++;
+        if (box.left_id == -1) {
+            intersect_leaf(box, triangles, ray, hit, stats);
+            box_id = links[box_id].skip;
+        } else {
+            box_id = box.left_id;
+        }
+    }
+    return hit;
+}
+
+// Child of an inner box the ray reaches first, judged by the box centers
+int near_child(const std::vector<Box> &boxes, const Box &box,
+               const Ray &ray) {
+    const Box &left = boxes[box.left_id];
+    const Box &right = boxes[box.right_id];
+    float along = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float offset = get_coord(axis, left.min) + get_coord(axis, left.max) -
+                       get_coord(axis, right.min) -
+                       get_coord(axis, right.max);
+        along += offset * get_coord(axis, ray.direction);
+    }
+    return along <= 0 ? box.left_id : box.right_id;
+}
+
+int sibling(const std::vector<Box> &boxes, int parent, int box_id) {
+    const Box &box = boxes[parent];
+    return box.left_id == box_id ? box.right_id : box.left_id;
+}
+
+Hit trace_bvh_parent(const std::vector<Box> &boxes, int root_id,
+                     const std::vector<StacklessLink> &links,
+                     const std::vector<TriangleForGLSL *> &triangles,
+                     const Ray &ray, TraversalStats &stats) {
+    enum { FROM_PARENT, FROM_SIBLING, FROM_CHILD };
+    Hit hit = no_hit();
+    const Box &root = boxes[root_id];
+    stats.boxes++;
+    if (intersect_ray_box(ray, root.min, root.max, hit.t) >= hit.t) {
+        return hit;
+    }
+    stats.nodes++;
+    if (root.left_id == -1) {
+        intersect_leaf(root, triangles, ray, hit, stats);
+        return hit;
+    }
+    int box_id = near_child(boxes, root, ray);
+    int state = FROM_PARENT;
+    while (true) {
+        int parent = links[box_id].parent;
+        if (state == FROM_CHILD) {
+            // Climbed out of `box_id`: its far sibling is next, or its
+            // parent is done too
+            if (box_id == root_id) {
+                return hit;
+            }
+            if (box_id == near_child(boxes, boxes[parent], ray)) {
+                box_id = sibling(boxes, parent, box_id);
+                state = FROM_SIBLING;
+            } else {
+                box_id = parent;
+            }
+            continue;
+        }
+        const Box &box = boxes[box_id];
+        stats.boxes++;
+        bool entered =
+            intersect_ray_box(ray, box.min, box.max, hit.t) < hit.t;
+        if (entered) {
+            stats.nodes++;
+        }
+        if (entered && box.left_id != -1) {
+            box_id = near_child(boxes, box, ray);
+            state = FROM_PARENT;
+            continue;
+        }
+        if (entered) {
+            intersect_leaf(box, triangles, ray, hit, stats);
+        }
+        if (state == FROM_PARENT) {
+            box_id = sibling(boxes, parent, box_id);
+            state = FROM_SIBLING;
+        } else {
+            box_id = parent;
+            state = FROM_CHILD;
+        }
+    }
+}
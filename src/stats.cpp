@@ -0,0 +1,123 @@
+#include "./stats.hpp"
+#include "./aabb.hpp"
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+BVHStats bvh_stats(const std::vector<Box> &boxes, int root_id,
+                   const BuildParams &params) {
+    BVHStats stats;
+    stats.node_bytes = boxes.size() * sizeof(Box);
+    if (root_id < 0) {
+        return stats;
+    }
+    stats.sah_cost = sah_cost(boxes, root_id, params);
+    float root_area = surface_area(box_bounds(boxes[root_id]));
+    double overlap_area = 0;
+    double overlap_ratio = 0;
+    size_t inner = 0;
+    std::vector<std::pair<int, int>> stack = {{root_id, 0}};
+    while (!stack.empty()) {
+        auto [box_id, depth] = stack.back();
+        stack.pop_back();
+        const Box &box = boxes[box_id];
+        stats.nodes++;
+        if (box.left_id == -1) {
+            size_t fill = box.end - box.start;
+            stats.leaves++;
+            if (stats.leaf_fill.size() <= fill) {
+                stats.leaf_fill.resize(fill + 1);
+            }
+            stats.leaf_fill[fill]++;
+            if (stats.leaf_depth.size() <= static_cast<size_t>(depth)) {
+                stats.leaf_depth.resize(depth + 1);
+            }
+            stats.leaf_depth[depth]++;
+            continue;
+        }
+        float overlap = surface_area(intersect_bounds(
+            box_bounds(boxes[box.left_id]), box_bounds(boxes[box.right_id])));
+        float area = surface_area(box_bounds(box));
+        overlap_area += overlap;
+        overlap_ratio += area > 0 ? overlap / area : 0;
+        inner++;
+        stack.push_back({box.left_id, depth + 1});
+        stack.push_back({box.right_id, depth + 1});
+    }
+    stats.sibling_overlap = root_area > 0 ? overlap_area / root_area : 0;
+    stats.mean_sibling_overlap = inner > 0 ? overlap_ratio / inner : 0;
+    return stats;
+}
+
+void write_histogram(std::ostream &out, const std::vector<size_t> &counts) {
+    out << "[";
+    for (size_t i = 0; i < counts.size(); ++i) {
+        out << (i > 0 ? ", " : "") << counts[i];
+    }
+    out << "]";
+}
+
+// Escapes quotes, backslashes and control characters of a file path
+std::string json_string(const std::string &text) {
+    std::string escaped = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            const char *digits = "0123456789abcdef";
+            escaped += "\\u00";
+            escaped += digits[(c >> 4) & 0xf];
+            escaped += digits[c & 0xf];
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+void write_bvh_json(std::ostream &out, const BVHStats &stats,
+                    const std::string &indent) {
+    out << "{\n"
+        << indent << "  \"sah_cost\": " << stats.sah_cost << ",\n"
+        << indent << "  \"nodes\": " << stats.nodes << ",\n"
+        << indent << "  \"leaves\": " << stats.leaves << ",\n"
+        << indent << "  \"node_bytes\": " << stats.node_bytes << ",\n"
+        << indent << "  \"sibling_overlap\": " << stats.sibling_overlap
+        << ",\n"
+        << indent << "  \"mean_sibling_overlap\": "
+        << stats.mean_sibling_overlap << ",\n"
+        << indent << "  \"leaf_fill\": ";
+    write_histogram(out, stats.leaf_fill);
+    out << ",\n" << indent << "  \"leaf_depth\": ";
+    write_histogram(out, stats.leaf_depth);
+    out << "\n" << indent << "}";
+}
+
+void write_stats_json(std::ostream &out, const SceneStats &stats) {
+    out << "{\n"
+        << "  \"builder\": " << json_string(stats.builder) << ",\n"
+        << "  \"bvh\": ";
+    write_bvh_json(out, stats.bvh, "  ");
+    if (!stats.meshes.empty()) {
+        out << ",\n  \"meshes\": [";
+        for (size_t i = 0; i < stats.meshes.size(); ++i) {
+            out << (i > 0 ? ",\n    " : "\n    ");
+            write_bvh_json(out, stats.meshes[i], "    ");
+        }
+        out << "\n  ]";
+    }
+    out << ",\n"
+        << "  \"triangles\": " << stats.triangles << ",\n"
+        << "  \"triangle_bytes\": " << stats.triangle_bytes << ",\n"
+        << "  \"textures\": " << stats.textures << ",\n"
+        << "  \"texture_bytes\": " << stats.texture_bytes << ",\n"
+        << "  \"files\": [";
+    for (size_t i = 0; i < stats.files.size(); ++i) {
+        out << (i > 0 ? "," : "") << "\n    {\"path\": "
+            << json_string(stats.files[i].path)
+            << ", \"triangles\": " << stats.files[i].triangles << "}";
+    }
+    out << (stats.files.empty() ? "" : "\n  ") << "]\n}" << std::endl;
+}
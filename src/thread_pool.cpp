@@ -0,0 +1,96 @@
+#include "./thread_pool.hpp"
+#include <algorithm>
+#include <thread>
+
+// Queue owned by the current thread; threads outside any pool use queue 0
+thread_local int current_queue = 0;
+
+ThreadPool::ThreadPool(int thread_count) {
+    thread_count = std::max(1, thread_count);
+    for (int i = 0; i < thread_count; ++i) {
+        queues.emplace_back(new WorkQueue());
+    }
+    for (int i = 1; i < thread_count; ++i) {
+        workers.emplace_back([this, i]() { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() const { return static_cast<int>(queues.size()); }
+
+void ThreadPool::run(TaskGroup &group, std::function<void()> task) {
+    group.pending++;
+    int queue = current_queue < size() ? current_queue : 0;
+    {
+        std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+        queues[queue]->tasks.push_back(Task{std::move(task), &group});
+    }
+    queued++;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup &group) {
+    int queue = current_queue < size() ? current_queue : 0;
+    while (group.pending > 0) {
+        if (!run_one(queue)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ThreadPool::run_one(int queue) {
+    Task task{nullptr, nullptr};
+    {
+        std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+        if (!queues[queue]->tasks.empty()) {
+            task = std::move(queues[queue]->tasks.back());
+            queues[queue]->tasks.pop_back();
+        }
+    }
+    for (int i = 1; i < size() && task.group == nullptr; ++i) {
+        WorkQueue &victim = *queues[(queue + i) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (task.group == nullptr) {
+        return false;
+    }
+    queued--;
+    task.function();
+    task.group->pending--;
+    return true;
+}
+
+void ThreadPool::worker_loop(int queue) {
+    current_queue = queue;
+    while (true) {
+        if (run_one(queue)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+int default_thread_count() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
@@ -0,0 +1,189 @@
+#include "./treelet.hpp"
+#include "./aabb.hpp"
+#include "./refit.hpp"
+#include "./thread_pool.hpp"
+#include <limits>
+#include <vector>
+
+const int TREELET_SUBSETS = 1 << TREELET_LEAVES;
+// Treelets are small, a task runs a few of them
+const int TREELET_GRAIN = 16;
+
+struct TreeletState {
+    std::vector<Box> &nodes;
+    // SAH cost of every subtree, not divided by the root area
+    std::vector<float> &costs;
+    const BuildParams &params;
+};
+
+struct Treelet {
+    int leaves[TREELET_LEAVES];
+    // The root first, then every node opened to grow the treelet
+    int internals[TREELET_LEAVES - 1];
+    int leaf_count;
+    int internal_count;
+};
+
+struct TreeletSearch {
+    Bounds bounds[TREELET_SUBSETS];
+    float costs[TREELET_SUBSETS];
+    // Leaves of the left child of the best topology over every subset
+    int splits[TREELET_SUBSETS];
+};
+
+float node_cost(const TreeletState &state, int node_id) {
+    const Box &node = state.nodes[node_id];
+    float area = surface_area(box_bounds(node));
+    if (node.left_id == -1) {
+        return state.params.intersection_cost * area * (node.end - node.start);
+    }
+    return state.params.traversal_cost * area + state.costs[node.left_id] +
+           state.costs[node.right_id];
+}
+
+Treelet form_treelet(const TreeletState &state, int root_id) {
+    const Box &root = state.nodes[root_id];
+    Treelet treelet{{root.left_id, root.right_id}, {root_id}, 2, 1};
+    while (treelet.leaf_count < TREELET_LEAVES) {
+        int largest = -1;
+        float largest_area = -1;
+        for (int i = 0; i < treelet.leaf_count; ++i) {
+            const Box &leaf = state.nodes[treelet.leaves[i]];
+            float area = surface_area(box_bounds(leaf));
+            if (leaf.left_id != -1 && area > largest_area) {
+                largest = i;
+                largest_area = area;
+            }
+        }
+        if (largest == -1) {
+            break;
+        }
+        int opened = treelet.leaves[largest];
+        treelet.internals[treelet.internal_count++] = opened;
+        treelet.leaves[largest] = state.nodes[opened].left_id;
+        treelet.leaves[treelet.leaf_count++] = state.nodes[opened].right_id;
+    }
+    return treelet;
+}
+
+// Cheapest topology over every subset of the leaves, smaller subsets first:
+// a subset is always numerically above its parts
+void search_treelet(const TreeletState &state, const Treelet &treelet,
+                    TreeletSearch &search) {
+    int full = (1 << treelet.leaf_count) - 1;
+    search.bounds[0] = empty_bounds();
+    for (int subset = 1; subset <= full; ++subset) {
+        int lowest = subset & -subset;
+        int leaf = __builtin_ctz(lowest);
+        search.bounds[subset] =
+            merge_bounds(search.bounds[subset ^ lowest],
+                         box_bounds(state.nodes[treelet.leaves[leaf]]));
+        if (subset == lowest) {
+            search.costs[subset] = state.costs[treelet.leaves[leaf]];
+            continue;
+        }
+        // Parts holding the lowest leaf, so every split is tried once
+        float best = std::numeric_limits<float>::max();
+        int best_split = lowest;
+        for (int part = (subset - 1) & subset; part > 0;
+             part = (part - 1) & subset) {
+            if ((part & lowest) == 0) {
+                continue;
+            }
+            float cost = search.costs[part] + search.costs[subset ^ part];
+            if (cost < best) {
+                best = cost;
+                best_split = part;
+            }
+        }
+        search.costs[subset] =
+            state.params.traversal_cost * surface_area(search.bounds[subset]) +
+            best;
+        search.splits[subset] = best_split;
+    }
+}
+
+// Rewires `node_id` over the leaves in `subset`, taking inner node ids from
+// the treelet in order
+void rebuild_treelet(TreeletState &state, const Treelet &treelet,
+                     const TreeletSearch &search, int subset, int node_id,
+                     int &next_internal) {
+    int parts[2] = {search.splits[subset], subset ^ search.splits[subset]};
+    int children[2];
+    for (int side = 0; side < 2; ++side) {
+        if ((parts[side] & (parts[side] - 1)) == 0) {
+            children[side] = treelet.leaves[__builtin_ctz(parts[side])];
+            continue;
+        }
+        children[side] = treelet.internals[next_internal++];
+        rebuild_treelet(state, treelet, search, parts[side], children[side],
+                        next_internal);
+    }
+    Box &node = state.nodes[node_id];
+    node.min = search.bounds[subset].min;
+    node.max = search.bounds[subset].max;
+    node.left_id = children[0];
+    node.right_id = children[1];
+    state.costs[node_id] = search.costs[subset];
+}
+
+void optimize_treelet(TreeletState &state, int root_id) {
+    if (state.nodes[root_id].left_id == -1) {
+        state.costs[root_id] = node_cost(state, root_id);
+        return;
+    }
+    Treelet treelet = form_treelet(state, root_id);
+    // Two leaves have no other topology
+    if (treelet.leaf_count < 3) {
+        state.costs[root_id] = node_cost(state, root_id);
+        return;
+    }
+
+    float current = 0;
+    for (int i = 0; i < treelet.internal_count; ++i) {
+        current += state.params.traversal_cost *
+                   surface_area(box_bounds(state.nodes[treelet.internals[i]]));
+    }
+    for (int i = 0; i < treelet.leaf_count; ++i) {
+        current += state.costs[treelet.leaves[i]];
+    }
+
+    TreeletSearch search;
+    search_treelet(state, treelet, search);
+    int full = (1 << treelet.leaf_count) - 1;
+    // Float noise must not reshuffle equal topologies every pass
+    if (search.costs[full] >= current * (1 - 1e-5f)) {
+        state.costs[root_id] = node_cost(state, root_id);
+        return;
+    }
+    int next_internal = 1;
+    rebuild_treelet(state, treelet, search, full, root_id, next_internal);
+}
+
+std::vector<float> optimize_treelets(std::vector<Box> &boxes,
+                                     std::vector<TriangleForGLSL *> &triangles,
+                                     AABB &aabb, const BuildParams &params,
+                                     int passes, ThreadPool &pool) {
+    std::vector<float> history = {sah_cost(boxes, aabb.root_id, params)};
+    std::vector<Box> nodes = boxes;
+    std::vector<float> costs(nodes.size());
+    TreeletState state{nodes, costs, params};
+    for (int pass = 0; pass < passes; ++pass) {
+        // Heights change as treelets are rebuilt, so the plan is remade,
+        // but within a pass a treelet only holds nodes of lower levels
+        RefitPlan plan = make_refit_plan(nodes, aabb.root_id);
+        for (const auto &level : plan.levels) {
+            pool.parallel_for(0, level.size(), TREELET_GRAIN, [&](int i) {
+                optimize_treelet(state, level[i]);
+            });
+        }
+        history.push_back(sah_cost(nodes, aabb.root_id, params));
+    }
+
+    boxes.clear();
+    AABB *linear = linearize_tree(boxes, triangles, nodes, aabb.root_id,
+                                  params);
+    aabb.root_id = linear->root_id;
+    delete linear;
+    return history;
+}
@@ -0,0 +1,247 @@
+#include "./triangle_streams.hpp"
+#include "./aabb.hpp"
+#include "./material_table.hpp"
+#include "./ray.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+const long long TRIANGLE_LINE_BYTES = 64;
+// Lines of the attribute stream, the welded vertices and the material table
+// are counted from here, apart from those of the geometry stream or the
+// indices
+const long long ATTRIBUTE_LINES = 1LL << 40;
+const long long VERTEX_LINES = 2LL << 40;
+const long long MATERIAL_LINES = 3LL << 40;
+
+TriangleAttributes triangle_attributes(const TriangleForGLSL &triangle) {
+    return TriangleAttributes{triangle.uv1, triangle.uv2, triangle.uv3,
+                              triangle.material_id, 0};
+}
+
+TriangleGeometry triangle_geometry(
+    const TriangleForGLSL &triangle,
+    const std::vector<MaterialForGLSL> &materials) {
+    const MaterialForGLSL &material = materials[triangle.material_id];
+    TriangleGeometry geometry{triangle.v1, triangle.v2, triangle.v3};
+    geometry.v1.padding = material.double_sided ? 1.0f : 0.0f;
+    geometry.v2.padding = material.alpha_cutoff;
+    geometry.v3.padding = 0;
+    return geometry;
+}
+
+TriangleEdges triangle_edges(const TriangleForGLSL &triangle,
+                             const std::vector<MaterialForGLSL> &materials) {
+    const MaterialForGLSL &material = materials[triangle.material_id];
+    const PaddedVec3ForGLSL &v1 = triangle.v1;
+    const PaddedVec3ForGLSL &v2 = triangle.v2;
+    const PaddedVec3ForGLSL &v3 = triangle.v3;
+    return TriangleEdges{
+        {v1.x, v1.y, v1.z, material.double_sided ? 1.0f : 0.0f},
+        {v2.x - v1.x, v2.y - v1.y, v2.z - v1.z, material.alpha_cutoff},
+        {v3.x - v1.x, v3.y - v1.y, v3.z - v1.z, 0}};
+}
+
+void split_triangles(const std::vector<TriangleForGLSL *> &triangles,
+                     const std::vector<MaterialForGLSL> &materials,
+                     std::vector<TriangleGeometry> &geometry,
+                     std::vector<TriangleAttributes> &attributes) {
+    geometry.resize(triangles.size());
+    attributes.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        const TriangleForGLSL &triangle = *triangles[i];
+        geometry[i] = triangle_geometry(triangle, materials);
+        attributes[i] = triangle_attributes(triangle);
+    }
+}
+
+void precompute_triangles(const std::vector<TriangleForGLSL *> &triangles,
+                          const std::vector<MaterialForGLSL> &materials,
+                          std::vector<TriangleEdges> &edges,
+                          std::vector<TriangleAttributes> &attributes) {
+    edges.resize(triangles.size());
+    attributes.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        const TriangleForGLSL &triangle = *triangles[i];
+        edges[i] = triangle_edges(triangle, materials);
+        attributes[i] = triangle_attributes(triangle);
+    }
+}
+
+void index_triangles(const std::vector<TriangleForGLSL *> &triangles,
+                     const std::vector<TriangleVertexIds> &vertex_ids,
+                     const std::vector<MaterialForGLSL> &materials,
+                     std::vector<PaddedVec3ForGLSL> &vertices,
+                     std::vector<TriangleIndices> &indices,
+                     std::vector<TriangleAttributes> &attributes) {
+    uint32_t id_count = 0;
+    for (const auto &ids : vertex_ids) {
+        id_count = std::max({id_count, ids.v1 + 1, ids.v2 + 1, ids.v3 + 1});
+    }
+    // Welded index of every vertex id, in the order the triangles first
+    // use them, so vertices of dropped triangles are not uploaded
+    const uint32_t unplaced = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> welded(id_count, unplaced);
+    vertices.clear();
+    indices.resize(triangles.size());
+    attributes.resize(triangles.size());
+    auto weld = [&](uint32_t id, const PaddedVec3ForGLSL &vertex) {
+        if (welded[id] == unplaced) {
+            welded[id] = vertices.size();
+            vertices.push_back(
+                PaddedVec3ForGLSL{vertex.x, vertex.y, vertex.z, 0});
+        }
+        return welded[id];
+    };
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        const TriangleForGLSL &triangle = *triangles[i];
+        const MaterialForGLSL &material = materials[triangle.material_id];
+        uint32_t flags = 0;
+        if (material.double_sided) {
+            flags |= TRIANGLE_DOUBLE_SIDED;
+        }
+        if (material.alpha_cutoff > 0) {
+            flags |= TRIANGLE_ALPHA_TESTED;
+        }
+        uint32_t v1 = weld(vertex_ids[i].v1, triangle.v1);
+        uint32_t v2 = weld(vertex_ids[i].v2, triangle.v2);
+        uint32_t v3 = weld(vertex_ids[i].v3, triangle.v3);
+        indices[i] = TriangleIndices{v1, v2, v3, flags};
+        attributes[i] = triangle_attributes(triangle);
+    }
+}
+
+// Appends the lines holding bytes [offset, offset + size)
+void touch_lines(std::vector<long long> &lines, long long offset,
+                 long long size) {
+    for (long long line = offset / TRIANGLE_LINE_BYTES;
+         line <= (offset + size - 1) / TRIANGLE_LINE_BYTES; ++line) {
+        lines.push_back(line);
+    }
+}
+
+// Lines shading the closest hit, or the alpha test of a candidate, reads:
+// its attributes, then its material
+void touch_shading(std::vector<long long> &lines,
+                   const std::vector<TriangleAttributes> &attributes,
+                   int triangle) {
+    long long attribute_size = sizeof(TriangleAttributes);
+    touch_lines(lines,
+                ATTRIBUTE_LINES * TRIANGLE_LINE_BYTES +
+                    triangle * attribute_size,
+                attribute_size);
+    long long material_size = sizeof(MaterialForGLSL);
+    touch_lines(lines,
+                MATERIAL_LINES * TRIANGLE_LINE_BYTES +
+                    attributes[triangle].material_id * material_size,
+                material_size);
+}
+
+void count_lines(std::vector<long long> &lines, TraversalStats &stats) {
+    std::sort(lines.begin(), lines.end());
+    stats.triangle_lines +=
+        std::unique(lines.begin(), lines.end()) - lines.begin();
+}
+
+Hit trace_full_triangles(const std::vector<Box> &boxes, int root_id,
+                         const std::vector<TriangleForGLSL> &triangles,
+                         const Ray &ray, TraversalStats &stats) {
+    std::vector<long long> lines;
+    long long size = sizeof(TriangleForGLSL);
+    Hit hit = trace_bvh(
+        boxes, root_id, ray, stats, [&](int i) {
+            // The vertices open the record, the alpha test reads the rest
+            if (triangles[i].alpha_cutoff > 0) {
+                touch_lines(lines, i * size, size);
+            } else {
+                touch_lines(lines, i * size, 3 * sizeof(PaddedVec3ForGLSL));
+            }
+            return intersect_ray_triangle(ray, triangles[i]);
+        });
+    if (hit.triangle != -1) {
+        touch_lines(lines, hit.triangle * size, size);
+    }
+    count_lines(lines, stats);
+    return hit;
+}
+
+Hit trace_split_triangles(const std::vector<Box> &boxes, int root_id,
+                          const std::vector<TriangleGeometry> &geometry,
+                          const std::vector<TriangleAttributes> &attributes,
+                          const Ray &ray, TraversalStats &stats) {
+    std::vector<long long> lines;
+    long long size = sizeof(TriangleGeometry);
+    Hit hit = trace_bvh(
+        boxes, root_id, ray, stats, [&](int i) {
+            touch_lines(lines, i * size, size);
+            const TriangleGeometry &triangle = geometry[i];
+            if (triangle.v2.padding > 0) {
+                touch_shading(lines, attributes, i);
+            }
+            return intersect_ray_vertices(ray, triangle.v1, triangle.v2,
+                                          triangle.v3);
+        });
+    if (hit.triangle != -1) {
+        touch_shading(lines, attributes, hit.triangle);
+    }
+    count_lines(lines, stats);
+    return hit;
+}
+
+Hit trace_precomputed_triangles(
+    const std::vector<Box> &boxes, int root_id,
+    const std::vector<TriangleEdges> &edges,
+    const std::vector<TriangleAttributes> &attributes, const Ray &ray,
+    TraversalStats &stats) {
+    std::vector<long long> lines;
+    long long size = sizeof(TriangleEdges);
+    Hit hit = trace_bvh(
+        boxes, root_id, ray, stats, [&](int i) {
+            touch_lines(lines, i * size, size);
+            const TriangleEdges &triangle = edges[i];
+            if (triangle.e1.padding > 0) {
+                touch_shading(lines, attributes, i);
+            }
+            return intersect_ray_edges(ray, triangle.v1, triangle.e1,
+                                       triangle.e2);
+        });
+    if (hit.triangle != -1) {
+        touch_shading(lines, attributes, hit.triangle);
+    }
+    count_lines(lines, stats);
+    return hit;
+}
+
+Hit trace_indexed_triangles(const std::vector<Box> &boxes, int root_id,
+                            const std::vector<PaddedVec3ForGLSL> &vertices,
+                            const std::vector<TriangleIndices> &indices,
+                            const std::vector<TriangleAttributes> &attributes,
+                            const Ray &ray, TraversalStats &stats) {
+    std::vector<long long> lines;
+    long long size = sizeof(TriangleIndices);
+    long long vertex_size = sizeof(PaddedVec3ForGLSL);
+    long long vertex_offset = VERTEX_LINES * TRIANGLE_LINE_BYTES;
+    Hit hit = trace_bvh(
+        boxes, root_id, ray, stats, [&](int i) {
+            const TriangleIndices &triangle = indices[i];
+            touch_lines(lines, i * size, size);
+            for (uint32_t vertex : {triangle.v1, triangle.v2, triangle.v3}) {
+                touch_lines(lines, vertex_offset + vertex * vertex_size,
+                            vertex_size);
+            }
+            if (triangle.flags & TRIANGLE_ALPHA_TESTED) {
+                touch_shading(lines, attributes, i);
+            }
+            return intersect_ray_vertices(ray, vertices[triangle.v1],
+                                          vertices[triangle.v2],
+                                          vertices[triangle.v3]);
+        });
+    if (hit.triangle != -1) {
+        touch_shading(lines, attributes, hit.triangle);
+    }
+    count_lines(lines, stats);
+    return hit;
+}
@@ -0,0 +1,327 @@
+#include "./view_bvh.hpp"
+#include "./aabb.hpp"
+#include "./early_split.hpp"
+#include "./ray.hpp"
+#include "./sah.hpp"
+#include "./thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Share of the split probability taken from the rays, the rest is area
+const float VIEW_RAY_WEIGHT = 0.8f;
+// Below this many rays a node is split by area alone
+const int VIEW_MIN_RAYS = 32;
+
+std::vector<CameraView> load_views(const std::string &path) {
+    std::vector<CameraView> views;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream values(line);
+        CameraView view{};
+        if (values >> view.position.x >> view.position.y >>
+            view.position.z >> view.pitch >> view.yaw) {
+            views.push_back(view);
+        }
+    }
+    return views;
+}
+
+bool append_view(const std::string &path, const CameraView &view) {
+    std::ofstream file(path, std::ios::app);
+    file << view.position.x << " " << view.position.y << " "
+         << view.position.z << " " << view.pitch << " " << view.yaw
+         << std::endl;
+    return static_cast<bool>(file);
+}
+
+std::vector<Ray> view_rays(const std::vector<CameraView> &views,
+                           int resolution) {
+    // 45 degrees, the initial field of view of the controls
+    float tan_half_fov = std::tan(0.3927f);
+    std::vector<Ray> rays;
+    rays.reserve(views.size() * resolution * resolution);
+    for (const auto &view : views) {
+        float cos_pitch = std::cos(view.pitch);
+        float sin_pitch = std::sin(view.pitch);
+        float cos_yaw = std::cos(view.yaw);
+        float sin_yaw = std::sin(view.yaw);
+        // The basis the controls move along
+        PaddedVec3ForGLSL forward{-sin_yaw * cos_pitch, sin_pitch,
+                                  -cos_yaw * cos_pitch, 0};
+        PaddedVec3ForGLSL right{cos_yaw, 0, -sin_yaw, 0};
+        PaddedVec3ForGLSL up{sin_yaw * sin_pitch, cos_pitch,
+                             cos_yaw * sin_pitch, 0};
+        for (int y = 0; y < resolution; ++y) {
+            for (int x = 0; x < resolution; ++x) {
+                float u = ((x + 0.5f) / resolution * 2 - 1) * tan_half_fov;
+                float v = ((y + 0.5f) / resolution * 2 - 1) * tan_half_fov;
+                PaddedVec3ForGLSL direction{
+                    forward.x + u * right.x + v * up.x,
+                    forward.y + u * right.y + v * up.y,
+                    forward.z + u * right.z + v * up.z, 0};
+                float length = std::sqrt(direction.x * direction.x +
+                                         direction.y * direction.y +
+                                         direction.z * direction.z);
+                direction.x /= length;
+                direction.y /= length;
+                direction.z /= length;
+                rays.push_back(make_ray(view.position, direction));
+            }
+        }
+    }
+    return rays;
+}
+
+std::vector<Ray> sample_view_rays(const std::vector<CameraView> &views) {
+    if (views.empty()) {
+        return {};
+    }
+    int resolution = std::sqrt(VIEW_SAMPLE_RAYS / views.size());
+    return view_rays(views, std::max(8, resolution));
+}
+
+struct ViewBuildState {
+    std::vector<Box> &boxes;
+    std::vector<SAHPrimitive> &primitives;
+    const std::vector<Ray> &rays;
+    // Distance of the first hit of every ray, infinity on a miss
+    const std::vector<float> &ray_ends;
+    const BuildParams &params;
+};
+
+// Whether the ray enters the box before its first hit, which counts a box
+// whose face the hit lies on
+bool ray_enters(const ViewBuildState &state, int ray, const Bounds &bounds) {
+    return std::isfinite(intersect_ray_box(state.rays[ray], bounds.min,
+                                           bounds.max, state.ray_ends[ray]));
+}
+
+// Like find_sah_split, but a child is reached with the blend of its share
+// of the area and its share of the `rays` that reach the node
+SAHSplit find_view_split(const ViewBuildState &state, int start, int end,
+                         const Bounds &bounds, const Bounds &centroids,
+                         const std::vector<int> &rays) {
+    const BuildParams &params = state.params;
+    SAHSplit best{-1, 0, std::numeric_limits<float>::max(), empty_bounds(),
+                  empty_bounds()};
+    float area = surface_area(bounds);
+    if (area <= 0) {
+        return best;
+    }
+    int bin_count = std::max(2, params.bin_count);
+    std::vector<SAHBin> bins(bin_count);
+    // left_bounds[i] covers bins [0, i], right_bounds[i] bins [i, bin_count)
+    std::vector<Bounds> left_bounds(bin_count);
+    std::vector<Bounds> right_bounds(bin_count);
+    std::vector<int> left_counts(bin_count);
+    std::vector<int> right_counts(bin_count);
+    std::vector<int> left_rays(bin_count);
+    std::vector<int> right_rays(bin_count);
+    for (int axis = 0; axis < 3; ++axis) {
+        float centroid_min = get_coord(axis, centroids.min);
+        float extent = get_coord(axis, centroids.max) - centroid_min;
+        if (extent <= 0) {
+            continue;
+        }
+        float scale = bin_count / extent;
+        std::fill(bins.begin(), bins.end(), SAHBin{empty_bounds(), 0});
+        for (int i = start; i < end; i++) {
+            SAHBin &bin = bins[sah_bin_index(
+                get_coord(axis, state.primitives[i].centroid), centroid_min,
+                scale, bin_count)];
+            bin.bounds = merge_bounds(bin.bounds, state.primitives[i].bounds);
+            bin.count++;
+        }
+        Bounds left = empty_bounds();
+        int left_count = 0;
+        for (int i = 0; i < bin_count; ++i) {
+            left = merge_bounds(left, bins[i].bounds);
+            left_count += bins[i].count;
+            left_bounds[i] = left;
+            left_counts[i] = left_count;
+        }
+        Bounds right = empty_bounds();
+        int right_count = 0;
+        for (int i = bin_count - 1; i >= 0; --i) {
+            right = merge_bounds(right, bins[i].bounds);
+            right_count += bins[i].count;
+            right_bounds[i] = right;
+            right_counts[i] = right_count;
+        }
+
+        // The left boxes only grow and the right ones only shrink, so a
+        // binary search finds the first left and the last right box each
+        // ray enters
+        std::fill(left_rays.begin(), left_rays.end(), 0);
+        std::fill(right_rays.begin(), right_rays.end(), 0);
+        for (int ray : rays) {
+            int low = 0;
+            int high = bin_count - 1;
+            while (low < high) {
+                int middle = (low + high) / 2;
+                if (ray_enters(state, ray, left_bounds[middle])) {
+                    high = middle;
+                } else {
+                    low = middle + 1;
+                }
+            }
+            left_rays[low]++;
+            low = 0;
+            high = bin_count - 1;
+            while (low < high) {
+                int middle = (low + high + 1) / 2;
+                if (ray_enters(state, ray, right_bounds[middle])) {
+                    low = middle;
+                } else {
+                    high = middle - 1;
+                }
+            }
+            right_rays[low]++;
+        }
+        for (int i = 1; i < bin_count; ++i) {
+            left_rays[i] += left_rays[i - 1];
+        }
+        for (int i = bin_count - 2; i >= 0; --i) {
+            right_rays[i] += right_rays[i + 1];
+        }
+
+        float ray_count = rays.size();
+        for (int i = 0; i < bin_count - 1; ++i) {
+            if (left_counts[i] == 0 || left_counts[i] == end - start) {
+                continue;
+            }
+            float left_share =
+                (1 - VIEW_RAY_WEIGHT) * surface_area(left_bounds[i]) / area +
+                VIEW_RAY_WEIGHT * left_rays[i] / ray_count;
+            float right_share =
+                (1 - VIEW_RAY_WEIGHT) * surface_area(right_bounds[i + 1]) /
+                    area +
+                VIEW_RAY_WEIGHT * right_rays[i + 1] / ray_count;
+            float cost = params.traversal_cost +
+                         params.intersection_cost *
+                             (left_share * left_counts[i] +
+                              right_share * right_counts[i + 1]);
+            if (cost < best.cost) {
+                best = SAHSplit{axis, i + 1, cost, left_bounds[i],
+                                right_bounds[i + 1]};
+            }
+        }
+    }
+    return best;
+}
+
+Box build_view_node(ViewBuildState &state, int start, int end,
+                    const std::vector<int> &rays) {
+    Bounds bounds = empty_bounds();
+    Bounds centroids = empty_bounds();
+    for (int i = start; i < end; i++) {
+        bounds = merge_bounds(bounds, state.primitives[i].bounds);
+        centroids = merge_bounds(centroids, state.primitives[i].centroid);
+    }
+
+    int span = end - start;
+    if (span <= 1) {
+        return Box(bounds.min, bounds.max, -1, -1, start, end);
+    }
+
+    SAHSplit split =
+        static_cast<int>(rays.size()) < VIEW_MIN_RAYS
+            ? find_sah_split(state.primitives, start, end, bounds, centroids,
+                             state.params)
+            : find_view_split(state, start, end, bounds, centroids, rays);
+    float leaf_cost = state.params.intersection_cost * span;
+    if (span <= state.params.leaf_size &&
+        (split.axis == -1 || leaf_cost <= split.cost)) {
+        return Box(bounds.min, bounds.max, -1, -1, start, end);
+    }
+
+    int mid = partition_sah_split(state.primitives, start, end, centroids,
+                                  split, state.params);
+    // The partition may fall back to the middle, so the children are
+    // bounded again rather than taken from the split
+    std::vector<int> child_rays[2];
+    int ranges[2][2] = {{start, mid}, {mid, end}};
+    for (int child = 0; child < 2; ++child) {
+        Bounds child_bounds = empty_bounds();
+        for (int i = ranges[child][0]; i < ranges[child][1]; i++) {
+            child_bounds =
+                merge_bounds(child_bounds, state.primitives[i].bounds);
+        }
+        for (int ray : rays) {
+            if (ray_enters(state, ray, child_bounds)) {
+                child_rays[child].push_back(ray);
+            }
+        }
+    }
+
+    state.boxes.emplace_back(build_view_node(state, start, mid,
+                                             child_rays[0]));
+    int left = state.boxes.size() - 1;
+    state.boxes.emplace_back(build_view_node(state, mid, end,
+                                             child_rays[1]));
+    int right = state.boxes.size() - 1;
+
+    return Box(bounds.min, bounds.max, left, right, start, end);
+}
+
+AABB *triangles_to_aabb_views(std::vector<Box> &boxes,
+                              std::vector<TriangleForGLSL *> &triangles,
+                              const std::vector<Ray> &rays,
+                              const BuildParams &params, ThreadPool &pool) {
+    if (params.clip_budget > 0) {
+        return build_clipped(
+            triangles, params,
+            [&](std::vector<TriangleForGLSL *> &references,
+                const BuildParams &unclipped) {
+                return triangles_to_aabb_views(boxes, references, rays,
+                                               unclipped, pool);
+            });
+    }
+    std::vector<float> ray_ends(rays.size());
+    {
+        std::vector<Box> sah_boxes;
+        std::vector<TriangleForGLSL *> sah_triangles = triangles;
+        AABB *sah = triangles_to_aabb_sah(sah_boxes, sah_triangles, params);
+        pool.parallel_for(0, rays.size(), 256, [&](int i) {
+            TraversalStats stats;
+            ray_ends[i] =
+                trace_bvh(sah_boxes, sah->root_id, sah_triangles, rays[i],
+                          stats)
+                    .t;
+        });
+        delete sah;
+    }
+
+    std::vector<SAHPrimitive> primitives(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        Bounds bounds = triangle_bounds(*triangles[i]);
+        primitives[i] =
+            SAHPrimitive{bounds, bounds_center(bounds), triangles[i]};
+    }
+    ViewBuildState state{boxes, primitives, rays, ray_ends, params};
+    Bounds scene = empty_bounds();
+    for (const auto &primitive : primitives) {
+        scene = merge_bounds(scene, primitive.bounds);
+    }
+    std::vector<int> root_rays;
+    for (size_t i = 0; i < rays.size(); ++i) {
+        if (ray_enters(state, i, scene)) {
+            root_rays.push_back(i);
+        }
+    }
+    boxes.emplace_back(
+        build_view_node(state, 0, triangles.size(), root_rays));
+    for (size_t i = 0; i < triangles.size(); i++) {
+        triangles[i] = primitives[i].triangle;
+    }
+    return new AABB{static_cast<int>(boxes.size() - 1)};
+}
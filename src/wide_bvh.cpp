@@ -0,0 +1,149 @@
+#include "./wide_bvh.hpp"
+#include "./aabb.hpp"
+#include "./ray.hpp"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+template <int N>
+void set_child(WideBox<N> &node, int slot, const Bounds &bounds, int child,
+               int count) {
+    node.min_x[slot] = bounds.min.x;
+    node.min_y[slot] = bounds.min.y;
+    node.min_z[slot] = bounds.min.z;
+    node.max_x[slot] = bounds.max.x;
+    node.max_y[slot] = bounds.max.y;
+    node.max_z[slot] = bounds.max.z;
+    node.child[slot] = child;
+    node.count[slot] = count;
+}
+
+template <int N>
+int collapse_node(std::vector<WideBox<N>> &nodes, const std::vector<Box> &boxes,
+                  int box_id) {
+    std::vector<int> children;
+    if (boxes[box_id].left_id == -1) {
+        children.push_back(box_id);
+    } else {
+        children.push_back(boxes[box_id].left_id);
+        children.push_back(boxes[box_id].right_id);
+    }
+    while (static_cast<int>(children.size()) < N) {
+        int largest = -1;
+        float largest_area = -1;
+        for (size_t i = 0; i < children.size(); ++i) {
+            const Box &child = boxes[children[i]];
+            float area = surface_area(box_bounds(child));
+            if (child.left_id != -1 && area > largest_area) {
+                largest = i;
+                largest_area = area;
+            }
+        }
+        if (largest == -1) {
+            break;
+        }
+        const Box &opened = boxes[children[largest]];
+        children[largest] = opened.left_id;
+        children.insert(children.begin() + largest + 1, opened.right_id);
+    }
+
+    int node_id = nodes.size();
+    nodes.emplace_back();
+    for (int slot = 0; slot < N; ++slot) {
+        set_child(nodes[node_id], slot, Bounds{}, -1, 0);
+    }
+    for (size_t slot = 0; slot < children.size(); ++slot) {
+        const Box &child = boxes[children[slot]];
+        if (child.left_id == -1) {
+            if (child.end > child.start) {
+                set_child(nodes[node_id], slot, box_bounds(child), child.start,
+                          child.end - child.start);
+            }
+            continue;
+        }
+        // The recursion grows `nodes`, so the slot is set afterwards
+        int child_id = collapse_node(nodes, boxes, children[slot]);
+        set_child(nodes[node_id], slot, box_bounds(child), child_id, 0);
+    }
+    return node_id;
+}
+
+template <int N>
+std::vector<WideBox<N>> collapse_bvh(const std::vector<Box> &boxes,
+                                     int root_id) {
+    std::vector<WideBox<N>> nodes;
+    nodes.reserve(boxes.size() / (N - 1) + 1);
+    collapse_node(nodes, boxes, root_id);
+    return nodes;
+}
+
+struct WideStackEntry {
+    int child;
+    int count;
+    float t;
+};
+
+template <int N>
+Hit trace_wide_bvh(const std::vector<WideBox<N>> &nodes,
+                   const std::vector<TriangleForGLSL *> &triangles,
+                   const Ray &ray, TraversalStats &stats) {
+    Hit hit = no_hit();
+    std::vector<WideStackEntry> stack = {{0, 0, 0.0f}};
+    WideStackEntry hits[N];
+    while (!stack.empty()) {
+        WideStackEntry entry = stack.back();
+        stack.pop_back();
+        if (entry.t >= hit.t) {
+            continue;
+        }
+        if (entry.count > 0) {
+            for (int i = entry.child; i < entry.child + entry.count; i++) {
+                stats.triangles++;
+                float t = intersect_ray_triangle(ray, *triangles[i]);
+                if (t < hit.t) {
+                    hit = Hit{t, i};
+                }
+            }
+            continue;
+        }
+
+        const WideBox<N> &node = nodes[entry.child];
+        stats.nodes++;
+        int hit_count = 0;
+        for (int slot = 0; slot < N; ++slot) {
+            if (node.child[slot] == -1) {
+                continue;
+            }
+            stats.boxes++;
+            float t = intersect_ray_box(
+                ray,
+                PaddedVec3ForGLSL{node.min_x[slot], node.min_y[slot],
+                                  node.min_z[slot], 0},
+                PaddedVec3ForGLSL{node.max_x[slot], node.max_y[slot],
+                                  node.max_z[slot], 0},
+                hit.t);
+            if (t < hit.t) {
+                hits[hit_count++] =
+                    WideStackEntry{node.child[slot], node.count[slot], t};
+            }
+        }
+        // Farthest first, so the nearest child is popped next
+        std::sort(hits, hits + hit_count,
+                  [](const WideStackEntry &a, const WideStackEntry &b) {
+                      return a.t > b.t;
+                  });
+        stack.insert(stack.end(), hits, hits + hit_count);
+    }
+    return hit;
+}
+
+template std::vector<WideBox<4>> collapse_bvh<4>(const std::vector<Box> &,
+                                                 int);
+template std::vector<WideBox<8>> collapse_bvh<8>(const std::vector<Box> &,
+                                                 int);
+template Hit trace_wide_bvh<4>(const std::vector<WideBox<4>> &,
+                               const std::vector<TriangleForGLSL *> &,
+                               const Ray &, TraversalStats &);
+template Hit trace_wide_bvh<8>(const std::vector<WideBox<8>> &,
+                               const std::vector<TriangleForGLSL *> &,
+                               const Ray &, TraversalStats &);